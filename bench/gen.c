@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes a synthetic TextJedi program for one workload into dir/<workload>.tj.
+// Workloads that use read also get their input file, dir/corpus.txt.
+//
+//   gen <decls|concat|records|read|edit|loop|search> <count> <dir>
+
+FILE* openOutput(const char *dir, const char *name) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot create %s\n", path);
+    exit(1);
+  }
+  return file;
+}
+
+// Deterministic pseudo-random text with short lines, about size bytes
+void writeInput(const char *dir, long size) {
+  FILE *file = openOutput(dir, "corpus.txt");
+  unsigned long state = 12345;
+  const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "error", "warning", "request", "jedi", "text"};
+  long written = 0;
+  while (written < size) {
+    state = state * 6364136223846793005UL + 1442695040888963407UL;
+    const char *word = words[(state >> 33) % 10];
+    written += fprintf(file, "%s%c", word, (state >> 40) % 8 == 0 ? '\n' : ' ');
+  }
+  fclose(file);
+}
+
+// Many variables, each assigned and used once
+void generateDecls(FILE *file, long count) {
+  for (long i = 0; i < count; i++) {
+    fprintf(file, "new int v%ld;\n", i);
+  }
+  for (long i = 0; i < count; i++) {
+    fprintf(file, "v%ld := %ld;\n", i, i);
+  }
+  for (long i = 1; i < count; i++) {
+    fprintf(file, "v%ld := v%ld + v%ld;\n", i, i, i - 1);
+  }
+  fprintf(file, "output v%ld;\n", count - 1);
+}
+
+// A long chain of concatenations building one large text
+void generateConcat(FILE *file, long count) {
+  fprintf(file, "new text record;\nnew text field;\nnew int length;\n");
+  fprintf(file, "field := \"field-value;\";\n");
+  for (long i = 0; i < count; i++) {
+    fprintf(file, "record := record + field;\n");
+    if (i % 64 == 0) {
+      fprintf(file, "record := record + \"|\";\n");
+    }
+  }
+  fprintf(file, "length := size(record);\noutput length;\nwrite record to concat_out;\n");
+}
+
+// Records built from ten fields per statement, read from input so the
+// optimizer cannot fold them
+void generateRecords(FILE *file, long count) {
+  fprintf(file, "new text record;\nnew text name;\nnew text all;\nnew int length;\n");
+  fprintf(file, "input name prompt name;\n");
+  for (long i = 0; i < count; i++) {
+    fprintf(file, "record := name + \",\" + name + \",%ld,\" + name + \";\" + name + \",\" + name + \"\\n\";\n", i);
+    fprintf(file, "all := all + record;\n");
+  }
+  fprintf(file, "length := size(all);\noutput length;\n");
+}
+
+// Repeated reads of a large file with searches and writes of the result
+void generateRead(FILE *file, long count, const char *dir) {
+  writeInput(dir, count * 1024);
+  fprintf(file, "new text doc;\nnew text needle;\nnew int length;\nnew int position;\n");
+  fprintf(file, "needle := \"request jedi\";\n");
+  for (long i = 0; i < 16; i++) {
+    fprintf(file, "read doc from corpus;\nlength := size(doc);\n");
+    fprintf(file, "position := locate(doc, needle, %ld);\n", i * 1024);
+  }
+  fprintf(file, "write doc to read_out;\noutput length;\noutput position;\n");
+}
+
+// Heavy locate, insert, override and subs on one document
+void generateEdit(FILE *file, long count, const char *dir) {
+  writeInput(dir, 1 << 20);
+  fprintf(file, "new text doc;\nnew text piece;\nnew text needle;\nnew text part;\nnew int position;\n");
+  fprintf(file, "read doc from corpus;\npiece := \"<edit>\";\nneedle := \"warning\";\n");
+  unsigned long state = 42;
+  for (long i = 0; i < count; i++) {
+    state = state * 6364136223846793005UL + 1442695040888963407UL;
+    long offset = (long) ((state >> 33) % 1000000);
+    fprintf(file, "position := locate(doc, needle, %ld);\n", offset);
+    fprintf(file, "doc := insert(doc, %ld, piece);\n", offset);
+    fprintf(file, "part := override(doc, %ld, piece);\n", offset / 2);
+    fprintf(file, "part := subs(doc, %ld, %ld);\n", offset, offset + 64);
+  }
+  fprintf(file, "write doc to edit_out;\noutput position;\n");
+}
+
+// The same locate, subs and concat on every line of the input, written as
+// one loop instead of count statements
+void generateLoop(FILE *file, long count, const char *dir) {
+  writeInput(dir, count * 64);
+  fprintf(file, "new text doc;\nnew text newline;\nnew text all;\nnew int start;\nnew int stop;\nnew int length;\n");
+  fprintf(file, "read doc from corpus;\nnewline := \"\n\";\n");
+  fprintf(file, "loop %ld times;\n", count);
+  fprintf(file, "  stop := locate(doc, newline, start);\n");
+  fprintf(file, "  all := all + subs(doc, start, stop);\n");
+  fprintf(file, "  start := stop + 1;\n");
+  fprintf(file, "end;\nlength := size(all);\noutput length;\n");
+}
+
+// Searches of a large file for needles it does not contain, each a full
+// scan unless the result cache already holds it
+void generateSearch(FILE *file, long count, const char *dir) {
+  writeInput(dir, count * 1024);
+  fprintf(file, "new text doc;\nnew text needle;\nnew int position;\nread doc from corpus;\n");
+  for (long i = 0; i < 16; i++) {
+    fprintf(file, "needle := \"needle %ld\";\nposition := locate(doc, needle, 0);\noutput position;\n", i);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <decls|concat|records|read|edit|loop|search> <count> <dir>\n", argv[0]);
+    return 1;
+  }
+  const char *workload = argv[1];
+  long count = strtol(argv[2], NULL, 10);
+  const char *dir = argv[3];
+  char name[256];
+  snprintf(name, sizeof(name), "%s.tj", workload);
+  FILE *file = openOutput(dir, name);
+  if (strcmp(workload, "decls") == 0) {
+    generateDecls(file, count);
+  } else if (strcmp(workload, "concat") == 0) {
+    generateConcat(file, count);
+  } else if (strcmp(workload, "records") == 0) {
+    generateRecords(file, count);
+  } else if (strcmp(workload, "read") == 0) {
+    generateRead(file, count, dir);
+  } else if (strcmp(workload, "edit") == 0) {
+    generateEdit(file, count, dir);
+  } else if (strcmp(workload, "loop") == 0) {
+    generateLoop(file, count, dir);
+  } else if (strcmp(workload, "search") == 0) {
+    generateSearch(file, count, dir);
+  } else {
+    fprintf(stderr, "Unknown workload: %s\n", workload);
+    return 1;
+  }
+  fclose(file);
+  return 0;
+}
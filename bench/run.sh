@@ -0,0 +1,95 @@
+#!/bin/sh
+# Builds the interpreter and the workload generator, runs every workload and
+# prints one JSON object per workload on stdout.
+#
+#   bench/run.sh [-s scale] [-b baseline.jsonl]
+#
+# -s multiplies the size of every workload (default 1).
+# -b compares against the output of an earlier run and exits with status 1
+#    when a phase became more than 10% slower.
+set -e
+
+SCALE=1
+BASELINE=
+while getopts "s:b:" option; do
+  case $option in
+    s) SCALE=$OPTARG ;;
+    b) BASELINE=$OPTARG ;;
+    *) echo "usage: $0 [-s scale] [-b baseline.jsonl]" >&2; exit 2 ;;
+  esac
+done
+
+CC=${CC:-cc}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$ROOT/bench/out
+mkdir -p "$OUT"
+$CC -O2 -pthread -o "$OUT/interpreter" "$ROOT/interpreter.c" "$ROOT/textjedi.c"
+$CC -O2 -o "$OUT/gen" "$ROOT/bench/gen.c"
+
+# measure <workload> <count> <name> [interpreter flags]
+measure() {
+  workload=$1
+  count=$2
+  name=$3
+  shift 3
+  if ! stats=$(cd "$OUT" && echo field | ./interpreter --stats --no-cache "$@" "$workload.tj" 2>&1 >"$workload.stdout"); then
+    echo "$workload failed: $(cat "$OUT/$workload.stdout")" >&2
+    exit 1
+  fi
+  echo "{\"workload\": \"$name\", \"count\": $count, ${stats#\{}"
+}
+
+run() {
+  count=$(($2 * SCALE))
+  "$OUT/gen" "$1" "$count" "$OUT"
+  measure "$1" "$count" "$1"
+}
+
+# The first run fills the result cache, the second finds every search in it
+runCached() {
+  count=$(($2 * SCALE))
+  "$OUT/gen" "$1" "$count" "$OUT"
+  rm -rf "$OUT/results"
+  measure "$1" "$count" "$1_miss" --result-cache="$OUT/results"
+  measure "$1" "$count" "$1_hit" --result-cache="$OUT/results"
+}
+
+RESULTS=$OUT/results.jsonl
+{
+  run decls 20000
+  run concat 200000
+  run records 50000
+  run read 16384
+  run edit 1000
+  run loop 100000
+  runCached search 32768
+} > "$RESULTS"
+cat "$RESULTS"
+
+if [ -n "$BASELINE" ]; then
+  awk '
+    function field(line, name) {
+      if (match(line, "\"" name "\": \"?[^,}\"]*")) {
+        value = substr(line, RSTART, RLENGTH)
+        sub(/^[^:]*: "?/, "", value)
+        return value
+      }
+      return ""
+    }
+    FNR == NR { baseline[field($0, "workload")] = $0; next }
+    {
+      workload = field($0, "workload")
+      if (!(workload in baseline)) next
+      split("lex_seconds parse_seconds execute_seconds", phases, " ")
+      for (i = 1; i <= 3; i++) {
+        before = field(baseline[workload], phases[i]) + 0
+        after = field($0, phases[i]) + 0
+        if (after > before * 1.10 && after - before > 0.005) {
+          printf "REGRESSION %s %s: %.6f -> %.6f\n", workload, phases[i], before, after > "/dev/stderr"
+          failed = 1
+        }
+      }
+    }
+    END { exit failed }
+  ' "$BASELINE" "$RESULTS"
+fi
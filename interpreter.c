@@ -1,709 +1,473 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <stdlib.h>
-#include <stdint.h>
-
-#define MAX_IDENT_LENGTH  30
+#include <time.h>
+#include "textjedi.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <pthread.h>
+#include <unistd.h>
+#define HAVE_RUSAGE
+#define HAVE_THREADS
+#define HAVE_ISATTY
+#endif
+
+long peakResidentKilobytes() {
+#ifdef HAVE_RUSAGE
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
 
-FILE* fp;
-int currentLine = 1;
-typedef enum {
-  IDENTIFIER,
-  INT_CONST,
-  OPERATOR,
-  STR_CONST,
-  KEYWORD,
-  ENDOFLINE,
-  NO_TYPE,
-  ENDOFFILE,
-  PARENTHESIS_OPEN,
-  PARENTHESIS_CLOSE,
-  COMMA
-} TokenType;
+// One JSON object on stderr, consumed by bench/run.sh
+void printStatistics(TJInterpreter *tj) {
+  TJStatistics statistics = tjGetStatistics(tj);
+  double totalSeconds = statistics.lexSeconds + statistics.parseSeconds + statistics.executeSeconds;
+  double megabytes = statistics.sourceBytes / 1e6;
+  fprintf(stderr, "{\"statements\": %d, \"instructions\": %zu, \"source_bytes\": %zu, "
+                  "\"lex_seconds\": %.6f, \"parse_seconds\": %.6f, \"execute_seconds\": %.6f, "
+                  "\"lex_mb_per_second\": %.2f, \"statements_per_second\": %.0f, "
+                  "\"peak_rss_kb\": %ld, \"arena_peak_bytes\": %zu, \"cache_hit\": %s, "
+                  "\"result_hits\": %zu, \"result_misses\": %zu}\n",
+          statistics.statements, statistics.instructions, statistics.sourceBytes,
+          statistics.lexSeconds, statistics.parseSeconds, statistics.executeSeconds,
+          statistics.lexSeconds > 0 ? megabytes / statistics.lexSeconds : 0,
+          totalSeconds > 0 ? statistics.statements / totalSeconds : 0,
+          peakResidentKilobytes(), statistics.arenaPeakBytes, statistics.cacheHit ? "true" : "false",
+          statistics.resultHits, statistics.resultMisses);
+}
 
-typedef enum {
-  INT,
-  TEXT
-} DataType;
+#ifdef HAVE_THREADS
+//BATCH
 
+// One script of a batch. Its output is collected here and printed once
+// every job before it in the list has been printed
 typedef struct {
-  TokenType type;
-  char* lexeme;
-} Token;
-
+  char* path;
+  char* output;
+  size_t outputSize;
+  size_t outputCapacity;
+  double seconds;
+  bool failed;
+  bool done;
+} Job;
+
+// Every queue holds a contiguous range of job indexes. The owner takes jobs
+// from the front, in list order, and an idle worker steals the back half,
+// so the jobs printed next are the ones run first
 typedef struct {
-  char name[MAX_IDENT_LENGTH];
-  char* value;
-  DataType type;
-} Variable;
+  pthread_mutex_t lock;
+  int top;
+  int bottom;
+} JobQueue;
 
-Variable* variables;
-size_t variablesSize = 0;
-
-void raiseError(char* message) {
-  printf("ERR! Line %d:  %s\n", currentLine, message);
-  exit(1);
-}
+typedef struct {
+  Job* jobs;
+  int jobCount;
+  JobQueue* queues;
+  int workerCount;
+  TJOptions options;
+  pthread_mutex_t printLock;
+  int nextToPrint;
+} Batch;
 
-char skipWhitespace(char ch) {
-  while (isspace(ch)) {
-    ch = (char) fgetc(fp);
-  }
-  return ch;
+typedef struct {
+  Batch* batch;
+  int index;
+  Job* job;
+  pthread_t thread;
+} Worker;
+
+double wallSeconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double) time.tv_sec + time.tv_nsec / 1e9;
 }
 
-char skipComment(char ch) {
-  if (ch == '/') {
-    ch = (char) fgetc(fp);
-    char nextc;
-    if (ch == '*') {
-      do {
-        if (nextc == EOF) {
-          raiseError("Comment cannot be terminated!");
-        }
-        ch = nextc;
-        nextc = (char) fgetc(fp);
-      } while (!(ch == '*' && nextc == '/'));
-      return (char) fgetc(fp);
-    } else {
-      raiseError("Unrecognized character: '/'");
+void appendOutput(void *context, const char *bytes, size_t length) {
+  Job *job = ((Worker*) context)->job;
+  if (job->outputSize + length > job->outputCapacity) {
+    size_t capacity = job->outputCapacity == 0 ? 256 : job->outputCapacity;
+    while (job->outputSize + length > capacity) {
+      capacity *= 2;
     }
-  }
-  return ch;
-}
-
-bool isKeyword (char str[]) {
-  const char* KEYWORDS[] = {"new", "int", "text", "size", "subs", "locate", "insert", "override", "read", "write",
-                           "from", "to", "input", "output", "asText", "asString"};
-  for (int i = 0; i < sizeof(KEYWORDS) / sizeof(KEYWORDS[0]); i++) {
-    if (strcmp(KEYWORDS[i], str) == 0) {
-      return true;
+    char *output = realloc(job->output, capacity);
+    if (output == NULL) {
+      return;
     }
+    job->output = output;
+    job->outputCapacity = capacity;
   }
-  return false;
+  memcpy(job->output + job->outputSize, bytes, length);
+  job->outputSize += length;
 }
 
-char isOperator (char ch) {
-  if (ch == '+' || ch == '-') { return ch; }
-  if (ch == ':') {
-    char nextCh = (char) fgetc(fp);
-    if (nextCh == '=') {
-      return '=';
-    }
-    raiseError("Invalid operator, assignment operator must be used like ':='");
-  }
-  return '\0';
+// Batch jobs have no input; every input statement reads an empty line
+size_t readNothing(void *context, char *buffer, size_t capacity) {
+  (void) context;
+  (void) buffer;
+  (void) capacity;
+  return 0;
 }
 
-Token getNextToken() {
-  Token token;
-  token.lexeme = calloc(MAX_IDENT_LENGTH, sizeof(char));
-  char ch = (char) fgetc(fp);
-
-  //SKIP WHITESPACE and COMMENT
-  while(isspace(ch) || ch == '/') {
-    ch = skipComment(ch);
-    ch = skipWhitespace(ch);
-    if (ch == EOF) {
-      token.type = ENDOFFILE;
-      token.lexeme[0] = '\0';
-      return token;
-    }
-  }
+int nextJob(Batch *batch, int self) {
+  JobQueue *own = &batch->queues[self];
+  pthread_mutex_lock(&own->lock);
+  if (own->top < own->bottom) {
+    int job = own->top++;
+    pthread_mutex_unlock(&own->lock);
+    return job;
+  }
+  pthread_mutex_unlock(&own->lock);
+  for (int i = 1; i < batch->workerCount; i++) {
+    JobQueue *victim = &batch->queues[(self + i) % batch->workerCount];
+    pthread_mutex_lock(&victim->lock);
+    int remaining = victim->bottom - victim->top;
+    if (remaining > 0) {
+      int first = victim->bottom - (remaining + 1) / 2;
+      int last = victim->bottom;
+      victim->bottom = first;
+      pthread_mutex_unlock(&victim->lock);
+      pthread_mutex_lock(&own->lock);
+      own->top = first + 1;
+      own->bottom = last;
+      pthread_mutex_unlock(&own->lock);
+      return first;
+    }
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return -1;
+}
 
-  //IDENTIFIER
-  if (isalpha(ch)) { // Starts with letter
-    int j = 0;
-    while ((isalnum(ch) || ch == '_')) {
-      token.lexeme[j++] = ch;
-      if(j > MAX_IDENT_LENGTH) {
-        char errMessage[56];
-        sprintf(errMessage, "Identifiers must be smaller or equal than %d characters!", MAX_IDENT_LENGTH);
-        raiseError(errMessage);
-      }
-      ch = (char) fgetc(fp);
-    }
-    ungetc(ch, fp);
-    token.lexeme[j] = '\0'; //null terminator, marks the end of a string
-    token.type = IDENTIFIER;
-    if(isKeyword(token.lexeme)){
-      token.type = KEYWORD;
-    }
-    return token;
+void finishJob(Batch *batch, int index) {
+  pthread_mutex_lock(&batch->printLock);
+  batch->jobs[index].done = true;
+  while (batch->nextToPrint < batch->jobCount && batch->jobs[batch->nextToPrint].done) {
+    Job *job = &batch->jobs[batch->nextToPrint++];
+    fwrite(job->output, 1, job->outputSize, stdout);
+    free(job->output);
+    job->output = NULL;
   }
+  pthread_mutex_unlock(&batch->printLock);
+}
 
-  //INTEGER
-  if (isdigit(ch)) {
-    unsigned long long value = 0;
-    while (isdigit(ch)) {
-      value = value * 10 + (ch - '0');
-      if(value > 4294967295 ) {
-        raiseError("Integer value is too big!");
+// Every worker keeps one interpreter for all its jobs, so tables and arena
+// chunks are reused from job to job
+void* runWorker(void *argument) {
+  Worker *worker = argument;
+  Batch *batch = worker->batch;
+  TJOptions options = batch->options;
+  options.host.context = worker;
+  options.host.write = appendOutput;
+  options.host.readLine = readNothing;
+  TJInterpreter *tj = tjCreate(&options);
+  int index;
+  while ((index = nextJob(batch, worker->index)) >= 0) {
+    Job *job = worker->job = &batch->jobs[index];
+    double start = wallSeconds();
+    TJStatus status = tj == NULL ? TJ_ERROR_OPEN : tjRunFile(tj, job->path);
+    if (status != TJ_OK) {
+      char message[256];
+      int length;
+      if (tj == NULL) {
+        length = snprintf(message, sizeof(message), "Out of memory!\n");
+      } else if (status == TJ_ERROR_OPEN) {
+        length = snprintf(message, sizeof(message), "%s\n", tjErrorMessage(tj));
+      } else {
+        length = snprintf(message, sizeof(message), "ERR! Line %d:  %s\n", tjErrorLine(tj), tjErrorMessage(tj));
       }
-      ch = (char) fgetc(fp);
+      appendOutput(worker, message, length < (int) sizeof(message) ? length : (int) sizeof(message) - 1);
     }
-    if (isalpha(ch) || ch == '_') {
-      raiseError("Invalid identifier, identifiers cannot start with a number!");
+    if (tj != NULL) {
+      tjReset(tj);
     }
-    ungetc(ch,fp);
-    sprintf(token.lexeme, "%llu", value);
-    token.type = INT_CONST;
-    return token;
-  }
-
-  //OPERATOR
-  char operator = isOperator(ch);
-  if (operator != '\0') {
-    token.type = OPERATOR;
-    token.lexeme[0] = operator;
-    token.lexeme[1] = '\0';
-    return token;
-  }
-
-  //PARENTHESIS_OPEN
-  if (ch == '(') {
-    token.type = PARENTHESIS_OPEN;
-    strcpy(token.lexeme, "(");
-    return token;
-  }
-
-  //PARENTHESIS_CLOSE
-  if (ch == ')') {
-    token.type = PARENTHESIS_CLOSE;
-    strcpy(token.lexeme, ")");
-    return token;
+    job->seconds = wallSeconds() - start;
+    job->failed = status != TJ_OK;
+    finishJob(batch, index);
   }
+  tjDestroy(tj);
+  return NULL;
+}
 
-  //COMMA
-  if (ch == ',') {
-    token.type = COMMA;
-    strcpy(token.lexeme, ",");
-    return token;
+void freeJobList(Job *jobs, int count) {
+  for (int i = 0; i < count; i++) {
+    free(jobs[i].path);
   }
+  free(jobs);
+}
 
-  //STRING CONSTANT
-  if (ch == '"') {
-    int j = 0;
-    ch = (char) fgetc(fp);
-    while (ch != '"') {
-      if (ch == EOF) {
-        raiseError("String cannot terminated!");
+// One path per line; empty lines and lines starting with # are skipped.
+// Returns false with error set when the list cannot be read
+bool readJobList(const char *file, Job **result, int *count, char *error, size_t errorSize) {
+  FILE *list = fopen(file, "r");
+  if (list == NULL) {
+    snprintf(error, errorSize, "Cannot open file: %s", file);
+    return false;
+  }
+  Job *jobs = NULL;
+  int capacity = 0;
+  int lineNumber = 0;
+  bool failed = false;
+  *count = 0;
+  char line[4096];
+  while (fgets(line, sizeof(line), list) != NULL) {
+    lineNumber++;
+    size_t length = strlen(line);
+    if (length == sizeof(line) - 1 && line[length - 1] != '\n' && getc(list) != EOF) {
+      snprintf(error, errorSize, "Line %d of %s is longer than %d bytes!", lineNumber, file, (int) sizeof(line) - 2);
+      failed = true;
+      break;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+    if (*count == capacity) {
+      int grown = capacity == 0 ? 64 : capacity * 2;
+      Job *resized = realloc(jobs, grown * sizeof(Job));
+      if (resized == NULL) {
+        snprintf(error, errorSize, "Out of memory!");
+        failed = true;
+        break;
       }
-      token.lexeme[j++] = ch;
-      ch = (char) fgetc(fp);
+      jobs = resized;
+      capacity = grown;
     }
-    token.lexeme[j] = '\0';
-    token.type = STR_CONST;
-    return token;
-  }
-
-  //ENDOFLINE
-  if (ch == ';') {
-    token.type = ENDOFLINE;
-    strcpy(token.lexeme, "");
-    return token;
-  }
-
-  char errMessage[50];
-  sprintf(errMessage, "Unrecognized character: '%c'!", ch);
-  raiseError(errMessage);
-}
-
-void parseDeclaration(Token *line) {
-  if (line[1].type != KEYWORD || line[2].type != IDENTIFIER || line[3].type != NO_TYPE) {
-    raiseError("Invalid variable initialization");
+    Job job = {.path = strdup(line)};
+    if (job.path == NULL) {
+      snprintf(error, errorSize, "Out of memory!");
+      failed = true;
+      break;
+    }
+    jobs[(*count)++] = job;
   }
-
-  Variable variable;
-  strcpy(variable.name, line[2].lexeme);
-  variable.value = calloc(1, sizeof(char));
-  variable.value = "";
-
-  if (strcmp(line[1].lexeme, "int") == 0) {
-    variable.type = INT;
-  } else if (strcmp(line[1].lexeme, "text") == 0) {
-    variable.type = TEXT;
-  } else {
-    char errMessage[50];
-    sprintf(errMessage, "Unrecognized type: %s!", line[1].lexeme);
-    raiseError(errMessage);
+  if (!failed && ferror(list)) {
+    snprintf(error, errorSize, "Cannot read file: %s", file);
+    failed = true;
   }
-  variables[variablesSize++] = variable;
-}
-
-Variable* getVariable(char *name) {
-  for (int i = 0; i < variablesSize; i++) {
-    if (strcmp(variables[i].name, name) == 0) {
-      return &variables[i];
-    }
+  fclose(list);
+  if (failed) {
+    freeJobList(jobs, *count);
+    return false;
   }
-  char errMessage[50];
-  sprintf(errMessage, "Variable not found: %s!", name);
-  raiseError(errMessage);
+  *result = jobs;
+  return true;
 }
 
-void parseOutput(Token *line) {
-  if (line[1].type != IDENTIFIER || line[2].type != NO_TYPE) {
-    raiseError("Invalid output statement!");
-  }
-  Variable variable = *getVariable(line[1].lexeme);
-  printf("%s\n", variable.value);
+int compareSeconds(const void *left, const void *right) {
+  double difference = *(const double*) left - *(const double*) right;
+  return (difference > 0) - (difference < 0);
 }
 
-void parseInput(Token *line) {
-  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
-    raiseError("Invalid input!");
-  }
-  if (line[2].type != KEYWORD && strcmp(line[2].lexeme, "prompt") != 0) {
-    raiseError("Invalid input!");
-  }
-  Variable prompt = *getVariable(line[3].lexeme);
-  printf("%s: ", prompt.value);
-  Variable* variable = getVariable(line[1].lexeme);
-  char buffer[100];
-  fgets(buffer, 100, stdin);
-  buffer[strcspn(buffer, "\n")] = 0;
-  variable->value = calloc(strlen(buffer) + 1, sizeof(char));
-  strcpy(variable->value, buffer);
+// Nearest-rank percentile of sorted latencies, in milliseconds
+double percentile(const double *sorted, int count, double rank) {
+  int index = (int) (rank * count + 0.999999) - 1;
+  return sorted[index < 0 ? 0 : index >= count ? count - 1 : index] * 1e3;
 }
 
-void parseRead(Token *line) {
-  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
-    raiseError("Invalid read!");
-  }
-  if (line[2].type != KEYWORD && strcmp(line[2].lexeme, "from") != 0) {
-    raiseError("Invalid read!");
-  }
-  Variable* variable = getVariable(line[1].lexeme);
-  char *fileName = strcat(line[3].lexeme, ".txt");
-  FILE *fp = fopen(fileName, "r");
-  if (fp == NULL) {
-    raiseError("File not found!");
-  }
-  fseek(fp, 0, SEEK_END);
-  long fsize = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  char *string = calloc(fsize + 1, sizeof(char));
-  fread(string, fsize, 1, fp);
-  fclose(fp);
-  variable->value = string;
+// One JSON object on stderr with throughput and job latencies
+void printBatchStatistics(Batch *batch, double seconds) {
+  double *latencies = malloc((batch->jobCount > 0 ? batch->jobCount : 1) * sizeof(double));
+  if (latencies == NULL) {
+    return;
+  }
+  int failed = 0;
+  for (int i = 0; i < batch->jobCount; i++) {
+    latencies[i] = batch->jobs[i].seconds;
+    failed += batch->jobs[i].failed;
+  }
+  qsort(latencies, batch->jobCount, sizeof(double), compareSeconds);
+  int count = batch->jobCount;
+  fprintf(stderr, "{\"jobs\": %d, \"failed\": %d, \"workers\": %d, \"wall_seconds\": %.6f, "
+                  "\"jobs_per_second\": %.1f, \"latency_p50_ms\": %.3f, \"latency_p90_ms\": %.3f, "
+                  "\"latency_p99_ms\": %.3f, \"latency_max_ms\": %.3f, \"peak_rss_kb\": %ld}\n",
+          count, failed, batch->workerCount, seconds, seconds > 0 ? count / seconds : 0,
+          count > 0 ? percentile(latencies, count, 0.50) : 0, count > 0 ? percentile(latencies, count, 0.90) : 0,
+          count > 0 ? percentile(latencies, count, 0.99) : 0, count > 0 ? latencies[count - 1] * 1e3 : 0,
+          peakResidentKilobytes());
+  free(latencies);
 }
 
-void parseWrite(Token *line) {
-  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
-    raiseError("Invalid write!");
+// Runs every script listed in file on workerCount threads in this process.
+// Outputs are printed in list order; files read by the jobs are mapped once
+// and shared between them
+int runBatch(const char *file, int workerCount, TJOptions options) {
+  Batch batch;
+  char error[256];
+  if (!readJobList(file, &batch.jobs, &batch.jobCount, error, sizeof(error))) {
+    printf("%s\n", error);
+    return 1;
   }
-  if (line[2].type != KEYWORD && strcmp(line[2].lexeme, "to") != 0) {
-    raiseError("Invalid write!");
+  if (workerCount > batch.jobCount) {
+    workerCount = batch.jobCount > 0 ? batch.jobCount : 1;
+  }
+  batch.workerCount = workerCount;
+  batch.options = options;
+  batch.options.profile = false;
+  batch.options.timeLexing = false;
+  batch.options.threads = 0;
+  batch.options.lineBuffered = false;
+  batch.options.files = tjCreateFileCache();
+  batch.nextToPrint = 0;
+  pthread_mutex_init(&batch.printLock, NULL);
+  batch.queues = malloc(workerCount * sizeof(JobQueue));
+  Worker *workers = malloc(workerCount * sizeof(Worker));
+  if (batch.queues == NULL || workers == NULL) {
+    printf("Out of memory!\n");
+    pthread_mutex_destroy(&batch.printLock);
+    tjDestroyFileCache(batch.options.files);
+    free(batch.queues);
+    free(workers);
+    freeJobList(batch.jobs, batch.jobCount);
+    return 1;
   }
-  Variable* variable = getVariable(line[1].lexeme);
-  char *fileName = strcat(line[3].lexeme, ".txt");
-  FILE *fp = fopen(fileName, "w");
-  if (fp == NULL) {
-    raiseError("File not found!");
+  for (int i = 0; i < workerCount; i++) {
+    pthread_mutex_init(&batch.queues[i].lock, NULL);
+    batch.queues[i].top = (int) ((long) batch.jobCount * i / workerCount);
+    batch.queues[i].bottom = (int) ((long) batch.jobCount * (i + 1) / workerCount);
   }
-  fprintf(fp, "%s", variable->value);
-  fclose(fp);
-}
 
-void parseAssignment(Token *line) {
-  if (line[0].type != IDENTIFIER) {
-    raiseError("Invalid assignment!");
+  double start = wallSeconds();
+  for (int i = 0; i < workerCount; i++) {
+    workers[i].batch = &batch;
+    workers[i].index = i;
+    workers[i].job = NULL;
   }
-  Variable *variable = getVariable(line[0].lexeme);
-  if (line[2].type == INT_CONST){
-    if (variable->type != INT) {
-      raiseError("Invalid assignment!");
-    }
-    variable->value = calloc(strlen(line[2].lexeme) + 1, sizeof(char));
-    strcpy(variable->value, line[2].lexeme);
-  } else if (line[2].type == STR_CONST){
-    if (variable->type != TEXT) {
-      raiseError("Invalid assignment!");
-    }
-    variable->value = calloc(strlen(line[2].lexeme) + 1, sizeof(char));
-    strcpy(variable->value, line[2].lexeme);
-  } else if (line[2].type == IDENTIFIER) {
-    Variable *variable2 = getVariable(line[2].lexeme);
-    if (variable->type != variable2->type) {
-      raiseError("Invalid assignment!");
+  int started = 0;
+  for (; started < workerCount; started++) {
+    if (pthread_create(&workers[started].thread, NULL, runWorker, &workers[started]) != 0) {
+      break;
     }
-    variable->value = calloc(strlen(variable2->value) + 1, sizeof(char));
-    strcpy(variable->value, variable2->value);
-  } else {
-    raiseError("Invalid assignment!");
   }
-}
-
-int sizeFunc(const char *string) {
-  int i = 0;
-  while (string[i] != '\0') {
-    i++;
+  if (started == 0) {
+    runWorker(&workers[0]);
   }
-  return i;
-}
-
-char* subsFunc(const char *string, int start, int end) {
-  char *substring = calloc(end - start + 1, sizeof(char));
-  int j = 0;
-  for (int i = start; i < end; i++) {
-    substring[j++] = string[i];
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
   }
-  return substring;
-}
+  double seconds = wallSeconds() - start;
+  fflush(stdout);
+  printBatchStatistics(&batch, seconds);
 
-int locateFunc(const char* bigText, const char* smallText, int start) {
-  int bigLen = (int) strlen(bigText);
-  int smallLen = (int) strlen(smallText);
-  if (start < 0 || start >= bigLen) {
-    return 0;
+  bool failed = false;
+  for (int i = 0; i < batch.jobCount; i++) {
+    failed = failed || batch.jobs[i].failed;
+    free(batch.jobs[i].path);
   }
-  int i, j;
-  for (i = start; i <= bigLen - smallLen; i++) {
-    for (j = 0; j < smallLen; j++) {
-      if (bigText[i + j] != smallText[j]) {
-        break;
-      }
-    }
-    if (j == smallLen) {
-      return i;
-    }
+  for (int i = 0; i < workerCount; i++) {
+    pthread_mutex_destroy(&batch.queues[i].lock);
   }
-  return 0;
-}
-
-char* insertFunc(char* myText, int location, const char* insertText) {
-  int textLen = (int) strlen(myText);
-  int insertLen = (int) strlen(insertText);
-  if (location < 0 || location > textLen) { return myText; }
-  int newLen = textLen + insertLen;
-  char* newText = (char*)malloc((newLen + 1) * sizeof(char));
-  if (newText == NULL) { return myText; }
-  strncpy(newText, myText, location);
-  strncpy(newText + location, insertText, insertLen);
-  strncpy(newText + location + insertLen, myText + location, textLen - location);
-  newText[newLen] = '\0';
-  return newText;
+  pthread_mutex_destroy(&batch.printLock);
+  tjDestroyFileCache(batch.options.files);
+  free(batch.queues);
+  free(workers);
+  free(batch.jobs);
+  return failed ? 1 : 0;
 }
-
-char* overrideFunc(const char* myText, int location, const char* ovrText) {
-  int textLen = (int) strlen(myText);
-  int ovrLen = (int) strlen(ovrText);
-  int newLen = location + ovrLen;
-  if (newLen > textLen) { newLen = textLen; }
-  char* newText = (char*)malloc((newLen + 1) * sizeof(char));
-  if (newText == NULL) { return NULL; }
-  strncpy(newText, myText, location);
-  strncpy(newText + location, ovrText, newLen - location);
-  newText[newLen] = '\0';
-  return newText;
+#else
+int runBatch(const char *file, int workerCount, TJOptions options) {
+  (void) file;
+  (void) workerCount;
+  (void) options;
+  printf("Batch mode needs threads\n");
+  return 1;
 }
+#endif
 
-void parseFunctionAssignment(Token *line) {
-  if(strcmp(line[2].lexeme, "size") == 0){
-    if(line[4].type != IDENTIFIER || line[5].type != PARENTHESIS_CLOSE || line[6].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *string = variable->value;
-    char *size = calloc(10, sizeof(char));
-    sprintf(size, "%d", sizeFunc(string));
-    Variable *variable2 = getVariable(line[0].lexeme);
-    if(variable2->type != INT){
-      raiseError("Invalid function assignment!");
-    }
-    variable2->value = calloc(strlen(size) + 1, sizeof(char));
-    strcpy(variable2->value, size);
-  } else if (strcmp(line[2].lexeme, "subs") == 0) {
-    if(line[4].type != IDENTIFIER || line[5].type != COMMA || line[6].type != INT_CONST || line[7].type != COMMA || line[8].type != INT_CONST || line[9].type != PARENTHESIS_CLOSE || line[10].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *string = variable->value;
-    int start = (int) strtol(line[6].lexeme, NULL, 10);
-    int end = (int) strtol(line[8].lexeme, NULL, 10);
-    char *substring = subsFunc(string, start, end);
-    Variable *variable2 = getVariable(line[0].lexeme);
-    if(variable2->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    variable2->value = calloc(strlen(substring) + 1, sizeof(char));
-    strcpy(variable2->value, substring);
-  } else if (strcmp(line[2].lexeme, "locate") == 0) {
-    if(line[4].type != IDENTIFIER || line[5].type != COMMA || line[6].type != IDENTIFIER || line[7].type != COMMA || line[8].type != INT_CONST || line[9].type != PARENTHESIS_CLOSE || line[10].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *bigText = variable->value;
-    Variable *variable2 = getVariable(line[6].lexeme);
-    if(variable2->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *smallText = variable2->value;
-    int start = (int) strtol(line[8].lexeme, NULL, 10);
-    int location = locateFunc(bigText, smallText, start);
-    Variable *variable3 = getVariable(line[0].lexeme);
-    if(variable3->type != INT){
-      raiseError("Invalid function assignment!");
-    }
-    variable3->value = calloc(10, sizeof(char));
-    sprintf(variable3->value, "%d", location);
-  } else if (strcmp(line[2].lexeme, "asString") == 0){
-    if(line[4].type != IDENTIFIER || line[5].type != PARENTHESIS_CLOSE || line[6].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != INT){
-      raiseError("Invalid function assignment!");
-    }
-    int number = (int) strtol(variable->value, NULL, 10);
-    char *string = calloc(10, sizeof(char));
-    sprintf(string, "%d", number);
-    Variable *variable2 = getVariable(line[0].lexeme);
-    if(variable2->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    variable2->value = calloc(strlen(string) + 1, sizeof(char));
-    strcpy(variable2->value, string);
-  } else if (strcmp(line[2].lexeme, "asText") == 0){
-    if(line[4].type != IDENTIFIER || line[5].type != PARENTHESIS_CLOSE || line[6].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    int number = (int) strtol(variable->value, NULL, 10);
-    char *string = calloc(10, sizeof(char));
-    sprintf(string, "%d", number);
-    Variable *variable2 = getVariable(line[0].lexeme);
-    if(variable2->type != INT){
-      raiseError("Invalid function assignment!");
-    }
-    variable2->value = calloc(strlen(string) + 1, sizeof(char));
-    strcpy(variable2->value, string);
-  } else if (strcmp(line[2].lexeme, "insert") == 0) {
-    if(line[4].type != IDENTIFIER || line[5].type != COMMA || line[6].type != INT_CONST || line[7].type != COMMA || line[8].type != IDENTIFIER || line[9].type != PARENTHESIS_CLOSE || line[10].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *myText = variable->value;
-    int position = (int) strtol(line[6].lexeme, NULL, 10);
-    Variable *variable2 = getVariable(line[8].lexeme);
-    if(variable2->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *insertText = variable2->value;
-    char *newText = insertFunc(myText, position, insertText);
-    Variable *variable3 = getVariable(line[0].lexeme);
-    if(variable3->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    variable3->value = calloc(strlen(newText) + 1, sizeof(char));
-    strcpy(variable3->value, newText);
-  } else if (strcmp(line[2].lexeme, "override") == 0) {
-    if(line[4].type != IDENTIFIER || line[5].type != COMMA || line[6].type != INT_CONST || line[7].type != COMMA || line[8].type != IDENTIFIER|| line[9].type != PARENTHESIS_CLOSE || line[10].type != NO_TYPE){
-      raiseError("Invalid function assignment!");
-    }
-    Variable *variable = getVariable(line[4].lexeme);
-    if(variable->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *myText = variable->value;
-    int position = (int) strtol(line[6].lexeme, NULL, 10);
-    Variable *variable2 = getVariable(line[8].lexeme);
-    if(variable2->type != TEXT){
-      raiseError("Invalid function assignment!");
-    }
-    char *overText = variable2->value;
-    char *newText = overrideFunc(myText, position, overText);
-    Variable *variable3 = getVariable(line[0].lexeme);
-    if(variable3->type != TEXT){
-      raiseError("Invalid function assignment!");
+int main(int argc, char *argv[]) {
+  char* file = "myprog.tj";
+  bool printStats = false;
+  bool profileAsJson = false;
+  char* batchFile = NULL;
+  int workerCount = 0;
+  TJOptions options = tjDefaultOptions();
+  options.useCache = true;
+#ifdef HAVE_ISATTY
+  options.lineBuffered = isatty(STDOUT_FILENO);
+#endif
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      printStats = true;
+    } else if (strcmp(argv[i], "--profile") == 0 || strcmp(argv[i], "--profile=table") == 0) {
+      options.profile = true;
+    } else if (strcmp(argv[i], "--profile=json") == 0) {
+      options.profile = true;
+      profileAsJson = true;
+    } else if (strcmp(argv[i], "--no-optimize") == 0) {
+      options.optimize = false;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      options.useCache = false;
+    } else if (strcmp(argv[i], "--rebuild-cache") == 0) {
+      options.rebuildCache = true;
+    } else if (strcmp(argv[i], "--parallel") == 0) {
+      options.threads = -1;
+    } else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+      options.threads = atoi(argv[i] + 11);
+    } else if (strncmp(argv[i], "--output-buffer=", 16) == 0) {
+      options.outputBuffer = (size_t) strtoul(argv[i] + 16, NULL, 10);
+    } else if (strcmp(argv[i], "--line-buffered") == 0) {
+      options.lineBuffered = true;
+    } else if (strcmp(argv[i], "--async-io") == 0) {
+      options.asyncIO = true;
+    } else if (strncmp(argv[i], "--result-cache=", 15) == 0) {
+      options.results = argv[i] + 15;
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batchFile = argv[++i];
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      workerCount = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+      workerCount = atoi(argv[i] + 2);
+    } else {
+      file = argv[i];
     }
-    variable3->value = calloc(strlen(newText) + 1, sizeof(char));
-    strcpy(variable3->value, newText);
-  } else {
-    raiseError("Invalid function assignment!");
   }
-}
-
-void parseArithmeticAssignment(Token *line) {
-  if (line[0].type != IDENTIFIER || line[3].type != OPERATOR || line[5].type != NO_TYPE) {
-    raiseError("Invalid arithmetic assignment!");
+  options.timeLexing = printStats;
+#ifdef HAVE_THREADS
+  if (options.threads < 0) {
+    options.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
   }
-  Variable *variable1 = getVariable(line[0].lexeme);
-  if(variable1->type == INT) {
-    int value1;
-    int value2;
-    if (line[2].type != INT_CONST && line[2].type != IDENTIFIER) {
-      raiseError("Invalid  arithmetic assignment!");
-    }
-    if (line[4].type != INT_CONST && line[4].type != IDENTIFIER) {
-      raiseError("Invalid arithmetic assignment!");
-    }
-    if (line[2].type == INT_CONST) {
-      value1 = strtol(line[2].lexeme, NULL, 10);
-    } else {
-      Variable *variable2 = getVariable(line[2].lexeme);
-      if (variable2->type != INT) {
-        raiseError("Invalid arithmetic assignment!");
-      }
-      value1 = strtol(variable2->value, NULL, 10);
-    }
-    if (line[4].type == INT_CONST) {
-      value2 = strtol(line[4].lexeme, NULL, 10);
-    } else {
-      Variable *variable2 = getVariable(line[4].lexeme);
-      if (variable2->type != INT) {
-        raiseError("Invalid arithmetic assignment!");
-      }
-      value2 = strtol(variable2->value, NULL, 10);
-    }
-    if (strcmp(line[3].lexeme, "+") == 0) {
-      variable1->value = calloc(10, sizeof(char));
-      sprintf(variable1->value, "%d", value1 + value2);
-    } else if (strcmp(line[3].lexeme, "-") == 0) {
-      variable1->value = calloc(10, sizeof(char));
-      sprintf(variable1->value, "%d", value1 - value2);
-      if (value1 - value2 < 0) {
-        raiseError("The answer cannot be negative!");
-      }
-    } else {
-      raiseError("Invalid arithmetic assignment!");
-    }
+#endif
+  if (options.asyncIO && options.threads > 1 && batchFile == NULL) {
+    fprintf(stderr, "Warning: --async-io is ignored when statements run in parallel\n");
   }
-
-  if(variable1->type == TEXT) {
-    char *value1;
-    char *value2;
-    if (line[2].type != STR_CONST && line[2].type != IDENTIFIER) {
-      raiseError("Invalid arithmetic assignment!");
-    }
-    if (line[4].type != STR_CONST && line[4].type != IDENTIFIER) {
-      raiseError("Invalid arithmetic assignment!");
-    }
-    if (line[2].type == STR_CONST) {
-      value1 = line[2].lexeme;
-    } else {
-      Variable *variable2 = getVariable(line[2].lexeme);
-      if (variable2->type != TEXT) {
-        raiseError("Invalid arithmetic assignment!");
-      }
-      value1 = variable2->value;
-    }
-    if (line[4].type == STR_CONST) {
-      value2 = line[4].lexeme;
-    } else {
-      Variable *variable2 = getVariable(line[4].lexeme);
-      if (variable2->type != TEXT) {
-        raiseError("Invalid arithmetic assignment!");
-      }
-      value2 = variable2->value;
-    }
-    if (strcmp(line[3].lexeme, "+") == 0) {
-      variable1->value = calloc(strlen(value1) + strlen(value2) + 1, sizeof(char));
-      strcpy(variable1->value, value1);
-      strcat(variable1->value, value2);
-    } else if (strcmp(line[3].lexeme, "-") == 0) {
-      if (strlen(value1) < strlen(value2)) {
-        raiseError("The subtrahend cannot be longer than the minuend!");
-      }
-      size_t resultLength = strlen(value1) - strlen(value2) + 1;
-      variable1->value = calloc(resultLength, sizeof(char));
-      char* found = strstr(value1, value2);
-      if (found != NULL) {
-        strncpy(variable1->value, value1, found - value1);
-        strcat(variable1->value, found + strlen(value2));
-      } else {
-        strcpy(variable1->value, value1);
-      }
-    } else {
-      raiseError("Invalid arithmetic assignment!");
+  if (batchFile != NULL) {
+#ifdef HAVE_THREADS
+    if (workerCount <= 0) {
+      workerCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
     }
+#endif
+    return runBatch(batchFile, workerCount > 0 ? workerCount : 1, options);
   }
-}
 
-void parseLine(Token *line) {
-  //DECLARATION
-  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "new") == 0) {
-    return parseDeclaration(line);
-  }
-  //COMMAND OUTPUT
-  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "output") == 0) {
-    return parseOutput(line);
+  TJInterpreter *tj = tjCreate(&options);
+  if (tj == NULL) {
+    printf("Out of memory!\n");
+    return 1;
   }
-  //COMMAND INPUT
-  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "input") == 0) {
-    return parseInput(line);
+  TJStatus status = tjCompileFile(tj, file);
+  if (status == TJ_OK) {
+    status = tjRun(tj);
   }
-  //COMMAND READ
-  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "read") == 0) {
-    return parseRead(line);
+  if (status == TJ_ERROR_OPEN) {
+    printf("%s\n", tjErrorMessage(tj));
+  } else if (status != TJ_OK) {
+    printf("ERR! Line %d:  %s\n", tjErrorLine(tj), tjErrorMessage(tj));
+  } else if (printStats) {
+    printStatistics(tj);
   }
-  //COMMAND WRITE
-  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "write") == 0) {
-    return parseWrite(line);
+  // A run stopped by an error is profiled up to the failing statement
+  if (options.profile && (status == TJ_OK || status == TJ_ERROR_RUNTIME)) {
+    fflush(stdout);
+    tjWriteProfile(tj, stderr, profileAsJson);
   }
-  //ASSIGNMENT
-  if (line[1].type == OPERATOR && strcmp(line[1].lexeme, "=") == 0) {
-    if(line[3].type == NO_TYPE) {
-      return parseAssignment(line);
-    } else if(line[2].type == KEYWORD && line[3].type == PARENTHESIS_OPEN){
-      return parseFunctionAssignment(line);
-    } else if(line[3].type == OPERATOR && line[5].type == NO_TYPE) {
-      return parseArithmeticAssignment(line);
-    } else {
-      raiseError("Invalid assignment!");
-    }
-  }
-  raiseError("Parsing error!");
+  tjDestroy(tj);
+  return status == TJ_OK ? 0 : 1;
 }
-
-int main(int argc, char *argv[]) {
-  variables = calloc(10, sizeof(Variable));
-  char* file = "myprog.tj";
-  if(argc > 1) {
-      file = argv[1];
-  }
-
-  fp = fopen(file, "r");
-
-  if(fp == NULL) {
-    printf("Cannot open file: %s\n", file);
-    return 1;
-  }
-
-  Token token;
-  char c = (char) fgetc(fp);
-  Token* line = calloc(10, sizeof(Token));
-  int i = 0;
-  while (c != EOF){
-    ungetc(c, fp);
-    token = getNextToken();
-    if (token.type != ENDOFLINE && token.type != ENDOFFILE) {
-      line[i++] = token;
-    } else if (token.type == ENDOFLINE) {
-      line[i].type = NO_TYPE;
-      parseLine(line);
-      line = calloc(10, sizeof(Token));
-      i = 0;
-      currentLine++;
-    }
-    c = (char) fgetc(fp);
-  }
-}
\ No newline at end of file
@@ -0,0 +1,81 @@
+// Runs a compiled program several times through the library, with and
+// without the optimizer, and checks that every run prints the same output.
+// Each run starts from zero and empty variables, so a program reading a
+// variable before storing it sees the same value every time.
+//
+//   rerun
+
+#include <stdio.h>
+#include <string.h>
+#include "../textjedi.h"
+
+typedef struct {
+  char bytes[256];
+  size_t length;
+} Output;
+
+void collect(void *context, const char *bytes, size_t length) {
+  Output *output = context;
+  if (output->length + length < sizeof(output->bytes)) {
+    memcpy(output->bytes + output->length, bytes, length);
+    output->length += length;
+  }
+}
+
+const char *source =
+  "new int a;\n"
+  "new int b;\n"
+  "new text t;\n"
+  "new text u;\n"
+  "b := a + 1;\n"
+  "a := b;\n"
+  "output a;\n"
+  "u := \"x\";\n"
+  "t := t + u;\n"
+  "output t;\n";
+
+int failures = 0;
+
+void rerun(bool optimize) {
+  Output output = {.length = 0};
+  TJOptions options = tjDefaultOptions();
+  options.optimize = optimize;
+  options.host.context = &output;
+  options.host.write = collect;
+  TJInterpreter *tj = tjCreate(&options);
+  if (tjCompileSource(tj, source, strlen(source)) != TJ_OK) {
+    fprintf(stderr, "optimize=%d: %s\n", optimize, tjErrorMessage(tj));
+    failures++;
+    tjDestroy(tj);
+    return;
+  }
+  char first[sizeof(output.bytes)];
+  size_t firstLength = 0;
+  for (int run = 0; run < 3; run++) {
+    output.length = 0;
+    if (tjRun(tj) != TJ_OK) {
+      fprintf(stderr, "optimize=%d, run %d: %s\n", optimize, run, tjErrorMessage(tj));
+      failures++;
+      break;
+    }
+    if (run == 0) {
+      memcpy(first, output.bytes, output.length);
+      firstLength = output.length;
+    } else if (output.length != firstLength || memcmp(output.bytes, first, firstLength) != 0) {
+      fprintf(stderr, "optimize=%d, run %d printed \"%.*s\", run 0 printed \"%.*s\"\n", optimize, run,
+              (int) output.length, output.bytes, (int) firstLength, first);
+      failures++;
+    }
+  }
+  tjDestroy(tj);
+}
+
+int main(void) {
+  rerun(false);
+  rerun(true);
+  if (failures > 0) {
+    fprintf(stderr, "%d runs differ from the first\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,107 @@
+#!/bin/sh
+# Builds the interpreter and runs every test, printing one line per test and
+# exiting with status 1 when any of them fails.
+#
+#   tests/run.sh
+set -e
+
+CC=${CC:-cc}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$ROOT/tests/out
+mkdir -p "$OUT"
+$CC -O2 -pthread -o "$OUT/interpreter" "$ROOT/interpreter.c" "$ROOT/textjedi.c"
+
+FAILED=0
+pass() { echo "ok   $1"; }
+fail() { echo "FAIL $1: $2"; FAILED=1; }
+
+# Peak resident size of running a script in $OUT, in kilobytes
+peakRss() {
+  stats=$(cd "$OUT" && ./interpreter --stats --no-cache "$@" 2>&1 >/dev/null)
+  echo "$stats" | sed -n 's/.*"peak_rss_kb": \([0-9]*\).*/\1/p'
+}
+
+# Running a compiled program again repeats its output, see tests/rerun.c
+rerun() {
+  $CC -O2 -pthread -o "$OUT/rerun" "$ROOT/tests/rerun.c" "$ROOT/textjedi.c"
+  if output=$("$OUT/rerun" 2>&1); then
+    pass "rerun with and without the optimizer"
+  else
+    fail "rerun with and without the optimizer" "$output"
+  fi
+}
+
+# A script read from a pipe has no size and is read until end of file; the
+# script is longer than the first read so the buffer has to grow
+pipedSource() {
+  {
+    echo "new text x;"
+    seq 1 20000 | sed 's/.*/x := "&";/'
+    echo "output x;"
+  } > "$OUT/piped.tj"
+  output=$(cd "$OUT" && ./interpreter --no-cache /dev/stdin < piped.tj 2>&1)
+  piped=$(cat "$OUT/piped.tj" | (cd "$OUT" && ./interpreter --no-cache /dev/stdin 2>&1))
+  if [ "$output" = "20000" ] && [ "$piped" = "20000" ]; then
+    pass "script from a pipe"
+  else
+    fail "script from a pipe" "printed '$piped' and '$output', expected 20000"
+  fi
+}
+
+# Editing and writing a 128 MiB file streams it in STREAM_CHUNK pieces, with
+# or without the I/O thread, so neither run should come near its size
+streamedWrite() {
+  if [ ! -f "$OUT/large.txt" ]; then
+    yes "a line of text that is repeated until the file is large enough" | head -c 134217728 > "$OUT/large.txt"
+  fi
+  cat > "$OUT/stream.tj" <<'SCRIPT'
+new text doc;
+new text p;
+read doc from large;
+p := "<mark>";
+doc := insert(doc, 1000, p);
+write doc to large_out;
+SCRIPT
+  for flags in "" "--async-io"; do
+    rss=$(peakRss $flags stream.tj)
+    if [ -z "$rss" ]; then
+      fail "streamed write $flags" "no statistics"
+    elif [ "$rss" -gt 65536 ]; then
+      fail "streamed write $flags" "peak RSS ${rss} kB"
+    elif [ "$(wc -c < "$OUT/large_out.txt")" -ne 134217734 ]; then
+      fail "streamed write $flags" "wrong output size"
+    else
+      pass "streamed write $flags (peak RSS ${rss} kB)"
+    fi
+  done
+  rm -f "$OUT/large_out.txt"
+}
+
+# The library and the command line build without warnings
+warnings() {
+  if output=$($CC -Wall -Wextra -O2 -pthread -o "$OUT/warnings" "$ROOT/interpreter.c" "$ROOT/textjedi.c" 2>&1) \
+     && [ -z "$output" ]; then
+    pass "no warnings with -Wall -Wextra"
+  else
+    fail "no warnings with -Wall -Wextra" "$output"
+  fi
+}
+
+# Every substring search path against the byte loop, see tests/search.c
+search() {
+  $CC -O2 -pthread -o "$OUT/search" "$ROOT/tests/search.c"
+  for seed in 1 2 3; do
+    if output=$("$OUT/search" $seed 2>&1); then
+      pass "search, seed $seed${output:+ ($output)}"
+    else
+      fail "search, seed $seed" "$output"
+    fi
+  done
+}
+
+warnings
+search
+rerun
+pipedSource
+streamedWrite
+exit $FAILED
@@ -0,0 +1,146 @@
+// Compares every substring search path with the byte loop locate used
+// before searchText existed, on random haystacks over small alphabets so
+// partial matches are common. Includes the library to reach its internals.
+//
+//   search [seed]
+
+#include "../textjedi.c"
+
+unsigned long state;
+
+unsigned long nextRandom(void) {
+  state = state * 6364136223846793005UL + 1442695040888963407UL;
+  return state >> 33;
+}
+
+size_t byteLoop(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  for (size_t i = start; i + m <= n; i++) {
+    size_t j = 0;
+    while (j < m && haystack[i + j] == needle[j]) {
+      j++;
+    }
+    if (j == m) {
+      return i;
+    }
+  }
+  return NOT_FOUND;
+}
+
+typedef size_t (*SearchFunction)(const char*, size_t, const char*, size_t, size_t);
+
+typedef struct {
+  const char* name;
+  SearchFunction search;
+  size_t minimum; // Shortest needle the path accepts
+  size_t maximum;
+} SearchPath;
+
+int failures = 0;
+
+void check(const char *name, size_t expected, size_t found, size_t n, size_t m, size_t start) {
+  if (found != expected && failures++ < 20) {
+    fprintf(stderr, "%s: n=%zu m=%zu start=%zu found %zu, expected %zu\n", name, n, m, start, found, expected);
+  }
+}
+
+void fillRandom(char *bytes, size_t length, int alphabet) {
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = (char) ('a' + nextRandom() % alphabet);
+  }
+}
+
+// Positions where a needle is planted: either side of 16 and 32 byte
+// blocks, the last possible position, and anywhere
+size_t plantPosition(size_t n, size_t m, size_t start) {
+  size_t room = n - m - start;
+  switch (nextRandom() % 4) {
+    case 0: return n - m;
+    case 1: return start + (16 * (nextRandom() % (room / 16 + 1)) + 15 + nextRandom() % 3) % (room + 1);
+    case 2: return start + (32 * (nextRandom() % (room / 32 + 1)) + 31 + nextRandom() % 3) % (room + 1);
+    default: return start + nextRandom() % (room + 1);
+  }
+}
+
+void comparePaths(SearchPath *paths, int pathsSize, int rounds) {
+  char haystack[4096], needle[256];
+  for (int round = 0; round < rounds; round++) {
+    size_t m = 1 + nextRandom() % 64;
+    if (round % 8 == 0) {
+      m = 65 + nextRandom() % 192; // Two-Way only
+    }
+    size_t n = m + nextRandom() % (sizeof(haystack) - m);
+    size_t start = nextRandom() % (n - m + 1);
+    int alphabet = 2 + nextRandom() % 3;
+    fillRandom(haystack, n, alphabet);
+    fillRandom(needle, m, alphabet);
+    if (nextRandom() % 4 != 0) {
+      memcpy(haystack + plantPosition(n, m, start), needle, m);
+    }
+    size_t expected = byteLoop(haystack, n, needle, m, start);
+    for (int i = 0; i < pathsSize; i++) {
+      if (m >= paths[i].minimum && m <= paths[i].maximum) {
+        check(paths[i].name, expected, paths[i].search(haystack, n, needle, m, start), n, m, start);
+      }
+    }
+  }
+}
+
+// searchLarge splits long texts into KERNEL_PIECE pieces across threads;
+// matches straddling a piece boundary or ending at the last byte must be
+// found, and the earliest one must win
+void comparePieces(void) {
+  TJOptions options = tjDefaultOptions();
+  options.threads = 4;
+  TJInterpreter *tj = tjCreate(&options);
+  size_t n = KERNEL_THRESHOLD + 3 * KERNEL_PIECE + 17;
+  Buffer *buffer = newBuffer(tj, n);
+  for (int round = 0; round < 24; round++) {
+    size_t m = 2 + nextRandom() % 63;
+    char needle[64];
+    memset(buffer->bytes, 'a', n);
+    fillRandom(needle, m, 2);
+    needle[0] = 'c';
+    size_t start = round % 3 == 0 ? nextRandom() % KERNEL_PIECE : 0;
+    size_t piece = 1 + nextRandom() % ((n - start) / KERNEL_PIECE - 1);
+    size_t positions[3] = {
+      start + piece * KERNEL_PIECE - 1 - nextRandom() % (m - 1), // Across a piece boundary
+      n - m,                                                    // Ending at the last byte
+      start + nextRandom() % (n - start - m)
+    };
+    size_t planted = round % 4 == 3 ? 0 : 1 + round % 3;
+    for (size_t i = 0; i < planted; i++) {
+      memcpy(buffer->bytes + positions[i], needle, m);
+    }
+    size_t expected = byteLoop(buffer->bytes, n, needle, m, start);
+    check("searchLarge", expected, searchLarge(tj, buffer, buffer->bytes, n, needle, m, start), n, m, start);
+  }
+  free(buffer);
+  tjDestroy(tj);
+}
+
+int main(int argc, char *argv[]) {
+  state = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+  SearchPath paths[] = {
+    {"searchText", searchText, 1, SIZE_MAX},
+    {"scalarSearch", scalarSearch, 1, SIZE_MAX},
+    {"twoWaySearch", twoWaySearch, 1, SIZE_MAX},
+#ifdef HAVE_SIMD_SEARCH
+    {"sse2Search", sse2Search, 2, SHORT_NEEDLE},
+    {"avx2Search", avx2Search, 2, SHORT_NEEDLE},
+#endif
+  };
+  int pathsSize = (int) (sizeof(paths) / sizeof(paths[0]));
+#ifdef HAVE_SIMD_SEARCH
+  if (!__builtin_cpu_supports("avx2")) {
+    pathsSize--;
+    printf("skipped avx2Search, not supported by this CPU\n");
+  }
+#endif
+  comparePaths(paths, pathsSize, 200000);
+  comparePieces();
+  if (failures > 0) {
+    fprintf(stderr, "%d searches differ from the byte loop\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,5060 @@
+#define _GNU_SOURCE
+#include "textjedi.h"
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <setjmp.h>
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#define HAVE_SIMD_SEARCH
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#define HAVE_MMAP
+#if defined(__GNUC__)
+#define HAVE_THREADS
+#endif
+#endif
+
+#define MAX_IDENT_LENGTH  30
+#define LINE_LOOKAHEAD    12
+#define ARENA_CHUNK_SIZE  65536
+#define ROPE_LEAF_SIZE    512
+#define SHORT_NEEDLE      64
+#define NOT_FOUND         SIZE_MAX
+#define WRITE_VECTORS     64
+#define SOURCE_PADDING    32
+#define KEYWORD_SLOTS     64
+#define PREFETCH_AHEAD    4
+#define WRITE_SLOTS       16
+#define OUTPUT_BUFFER     65536
+#define INDEX_MIN_LENGTH  65536
+#define INDEX_SCANS       64
+#define STREAM_THRESHOLD  (64 << 20)
+#define STREAM_CHUNK      (4 << 20)
+#define KERNEL_THRESHOLD  (16 << 20)
+#define KERNEL_PIECE      (1 << 20)
+#define KERNEL_THREADS    64
+#define RESULT_MIN_BYTES  4096
+#define RESULT_ENTRIES    (1 << 20)
+#define RESULT_NEEDLE     32
+#define RESULT_FILES      (1 << 16)
+
+typedef enum {
+  IDENTIFIER,
+  INT_CONST,
+  OPERATOR,
+  STR_CONST,
+  KEYWORD,
+  ENDOFLINE,
+  NO_TYPE,
+  ENDOFFILE,
+  PARENTHESIS_OPEN,
+  PARENTHESIS_CLOSE,
+  COMMA
+} TokenType;
+
+typedef enum {
+  INT,
+  TEXT
+} DataType;
+
+typedef struct {
+  TokenType type;
+  char* lexeme;
+  size_t length; // String constants may contain NUL bytes
+} Token;
+
+typedef enum {
+  HEAP_BUFFER,
+  MAPPED_BUFFER,
+  SHARED_BUFFER // Owned by a TJFileCache, never counted or freed here
+} BufferKind;
+
+// Positions of every 4-byte gram of a buffer, bucketed by a hash of the
+// gram and ascending within each bucket, see searchIndexed
+typedef struct {
+  uint32_t* starts;
+  uint32_t* positions;
+  int shift;
+} SearchIndex;
+
+// Reference-counted bytes shared by every rope leaf that views them. Bytes
+// never change, so a search index built once, like the content hash used by
+// the result cache (0 until computed), stays valid for the buffer's lifetime
+typedef struct {
+  int references;
+  BufferKind kind;
+  char* bytes;
+  size_t length;
+  size_t scanned;
+  SearchIndex* index;
+  uint64_t hash;
+} Buffer;
+
+// TEXT values are immutable, reference-counted ropes: leaves view a slice of
+// a Buffer, concat nodes are kept balanced by depth. bytes and buffer are
+// also set on a concat node once it has been flattened, so later reads
+// reuse it. Assignment shares a rope; edits build new nodes around it.
+typedef struct Rope {
+  int references;
+  struct Rope* left;
+  struct Rope* right;
+  Buffer* buffer;
+  const char* bytes;
+  size_t length;
+  int depth;
+} Rope;
+
+// INT values are kept as native integers and only formatted when printed
+typedef struct {
+  DataType type;
+  union {
+    int64_t number;
+    Rope* text;
+  };
+} Value;
+
+typedef struct {
+  const char* name;
+  Value value;
+} Variable;
+
+// Interned identifier; variable is its slot in variables or -1 if undeclared
+typedef struct {
+  char* name;
+  uint32_t hash;
+  int variable;
+} Symbol;
+
+// Bump allocator for lexemes and statement buffers, rewound after every
+// statement; chunks are kept so steady-state lexing does not call malloc
+typedef struct ArenaChunk {
+  struct ArenaChunk* next;
+  size_t size;
+  char data[];
+} ArenaChunk;
+
+typedef struct {
+  ArenaChunk* first;
+  ArenaChunk* current;
+  size_t offset;
+  size_t used;
+  size_t peak;
+} Arena;
+
+typedef enum {
+  OP_HALT,
+  OP_OUTPUT,
+  OP_INPUT,
+  OP_READ,
+  OP_WRITE,
+  OP_MOVE,
+  OP_SIZE,
+  OP_SUBS,
+  OP_LOCATE,
+  OP_AS_STRING,
+  OP_AS_TEXT,
+  OP_INSERT,
+  OP_OVERRIDE,
+  OP_ADD,
+  OP_SUB,
+  OP_CONCAT,
+  OP_REMOVE,
+  OP_JOIN,
+  OP_LOOP,
+  OP_END_LOOP,
+  OP_APPEND_SUBS
+} OpCode;
+
+// a, b, c, d are indexes into variables; constants and file names are stored
+// there as anonymous variables so every operand is resolved before running.
+// OP_JOIN takes c operands listed from program.operands[b] instead. OP_LOOP
+// keeps the index of its OP_END_LOOP in c and the end the index of its loop
+// in b, see linkLoops
+typedef struct {
+  OpCode op;
+  int line;
+  int a;
+  int b;
+  int c;
+  int d;
+} Instruction;
+
+typedef struct {
+  Instruction* code;
+  size_t size;
+  size_t capacity;
+  int* operands;
+  size_t operandsSize;
+  size_t operandsCapacity;
+} Program;
+
+#define OP_COUNT (OP_APPEND_SUBS + 1)
+
+#ifdef HAVE_MMAP
+// Files read through mmap; ropes may point into these until released
+typedef struct {
+  char* path;
+  dev_t device;
+  ino_t inode;
+  Buffer* buffer;
+} MappedFile;
+#endif
+
+#ifdef HAVE_THREADS
+typedef struct AsyncIO AsyncIO;
+#endif
+
+// A search of text for needle from start and where it found it, keyed by
+// searchKey. Hits compare the lengths, start and needle too, so only texts
+// of equal length whose hashes collide can be mistaken for each other
+typedef struct {
+  uint64_t key;
+  uint64_t textLength;
+  uint64_t start;
+  uint64_t needleLength;
+  uint64_t found;
+  char needle[RESULT_NEEDLE];
+} CachedResult;
+
+// The content hash of one version of a file, saved with the results so a
+// later run reading the file does not hash it again. buffer is the mapping
+// of that version while this interpreter holds it, and is not saved
+typedef struct {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  uint64_t modified;
+  uint64_t changed;
+  uint64_t hash;
+} FileHash;
+
+typedef struct {
+  FileHash file;
+  Buffer* buffer;
+} KnownFile;
+
+// Output not yet written, see writeOutput. The copies in runParallel share
+// the buffer of the interpreter they run for; output statements never run
+// at the same time
+typedef struct {
+  char* bytes;
+  size_t size;
+  size_t capacity;
+} Output;
+
+typedef struct {
+  long count;
+  double totalSeconds;
+  double maxSeconds;
+  size_t allocatedBytes;
+  size_t textBytes;
+} ProfileEntry;
+
+// Everything one interpreter owns; nothing else in the library is mutable,
+// so separate interpreters can run on separate threads without locking
+struct TJInterpreter {
+  TJOptions options;
+  jmp_buf onError;
+  TJStatus status;
+  // Set on the per-thread copies that run statements in parallel, see
+  // runParallel; shared ropes and buffers then change counts atomically
+  bool concurrent;
+  char errorMessage[128];
+  int errorLine;
+  Output* output;
+  Output ownOutput;
+
+  // The whole script is loaded once and followed by SOURCE_PADDING zero
+  // bytes, so the lexer can look ahead and use 16-byte loads without bounds
+  // checks
+  char* source;
+  const char* cursor;
+  const char* sourceEnd;
+  uint64_t sourceHash;
+  int currentLine;
+  int compiledLines;
+
+  Variable* variables;
+  size_t variablesSize;
+  size_t variablesCapacity;
+  Symbol* symbols;
+  size_t symbolsSize;
+  size_t symbolsCapacity;
+  Program program;
+  bool programMapped;
+  Arena arena;
+  int* temporaries[2];
+  int temporariesSize[2];
+#ifdef HAVE_MMAP
+  MappedFile* mappedFiles;
+  size_t mappedFilesSize;
+  size_t mappedFilesCapacity;
+#endif
+#ifdef HAVE_THREADS
+  // Prefetching and write-behind while a run has asyncIO set
+  AsyncIO* io;
+#endif
+
+  // Optimizer state, see optimizeProgram
+  int* knownValues;
+  size_t userSlots;
+  int* constantUses;
+  size_t constantUsesCapacity;
+  int* freeConstants;
+  size_t freeConstantsSize;
+  size_t freeConstantsCapacity;
+
+  char* cachePath;
+  TJFileCache* ownFiles;
+  bool cacheHit;
+  Buffer* cacheBuffer;
+
+  // Search results of this and earlier runs, see findResult. Kept across
+  // compiles, since entries are keyed by content
+  CachedResult* results;
+  size_t resultsSize;
+  size_t resultsCapacity;
+  bool resultsLoaded;
+  bool resultsChanged;
+  size_t resultHits;
+  size_t resultMisses;
+  KnownFile* knownFiles;
+  size_t knownFilesSize;
+  size_t knownFilesCapacity;
+
+  double lexSeconds;
+  double compileSeconds;
+  double executeSeconds;
+
+  // Heap allocations made while running; profiling attributes them to
+  // statements
+  size_t bytesAllocated;
+  ProfileEntry opProfile[OP_COUNT];
+  ProfileEntry* lineProfile;
+  int profiledLines;
+  Instruction* profiledInstruction;
+  double profileStart;
+  size_t profileAllocated;
+  size_t profileText;
+};
+
+// Stops the current compile or run and returns its error to the caller of
+// the public function that started it
+static _Noreturn void raiseError(TJInterpreter *tj, const char* message) {
+  snprintf(tj->errorMessage, sizeof(tj->errorMessage), "%s", message);
+  tj->errorLine = tj->currentLine;
+  longjmp(tj->onError, 1);
+}
+
+static void* arenaAlloc(TJInterpreter *tj, size_t size) {
+  size = (size + 7) & ~(size_t) 7;
+  while (tj->arena.current == NULL || tj->arena.offset + size > tj->arena.current->size) {
+    ArenaChunk *next = tj->arena.current == NULL ? tj->arena.first : tj->arena.current->next;
+    if (next == NULL || next->size < size) {
+      size_t chunkSize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+      ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + chunkSize);
+      if (chunk == NULL) {
+        raiseError(tj, "Out of memory!");
+      }
+      chunk->size = chunkSize;
+      chunk->next = next;
+      if (tj->arena.current == NULL) {
+        tj->arena.first = chunk;
+      } else {
+        tj->arena.current->next = chunk;
+      }
+      next = chunk;
+    }
+    if (tj->arena.current != NULL) {
+      tj->arena.used += tj->arena.current->size - tj->arena.offset;
+    }
+    tj->arena.current = next;
+    tj->arena.offset = 0;
+  }
+  void *memory = tj->arena.current->data + tj->arena.offset;
+  tj->arena.offset += size;
+  tj->arena.used += size;
+  if (tj->arena.used > tj->arena.peak) {
+    tj->arena.peak = tj->arena.used;
+  }
+  return memory;
+}
+
+static void arenaReset(TJInterpreter *tj) {
+  tj->arena.current = NULL;
+  tj->arena.offset = 0;
+  tj->arena.used = 0;
+}
+
+static void* allocate(TJInterpreter *tj, size_t size) {
+  void *memory = malloc(size);
+  if (memory == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  tj->bytesAllocated += size;
+  return memory;
+}
+
+// Returns NULL when out of memory, so callers holding other resources can
+// release them before raising
+static Buffer* tryNewBuffer(TJInterpreter *tj, size_t length) {
+  Buffer *buffer = malloc(sizeof(Buffer) + length + 1);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  tj->bytesAllocated += sizeof(Buffer) + length + 1;
+  buffer->references = 0;
+  buffer->kind = HEAP_BUFFER;
+  buffer->bytes = (char*) (buffer + 1);
+  buffer->bytes[length] = '\0';
+  buffer->length = length;
+  buffer->scanned = 0;
+  buffer->index = NULL;
+  buffer->hash = 0;
+  return buffer;
+}
+
+static Buffer* newBuffer(TJInterpreter *tj, size_t length) {
+  Buffer *buffer = tryNewBuffer(tj, length);
+  if (buffer == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  return buffer;
+}
+
+static int addReferences(TJInterpreter *tj, int *references, int delta) {
+#ifdef HAVE_THREADS
+  if (tj->concurrent) {
+    return __atomic_add_fetch(references, delta, __ATOMIC_ACQ_REL);
+  }
+#else
+  (void) tj;
+#endif
+  return *references += delta;
+}
+
+// Mapped files of STREAM_THRESHOLD bytes or more are streamed: searches,
+// output and writes go through them STREAM_CHUNK bytes at a time and give
+// the pages behind them back, so memory use does not grow with the file
+static bool isStreamed(Buffer *buffer) {
+  return buffer != NULL && buffer->kind != HEAP_BUFFER && buffer->length >= STREAM_THRESHOLD;
+}
+
+// Only for streamed buffers: their mappings are read-only, so dropped pages
+// are read back from the file if they are needed again
+static void releasePages(const char *bytes, size_t length) {
+#ifdef HAVE_MMAP
+  uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+  uintptr_t first = ((uintptr_t) bytes + page - 1) & ~(page - 1);
+  uintptr_t last = ((uintptr_t) bytes + length) & ~(page - 1);
+  if (last > first) {
+    madvise((void*) first, last - first, MADV_DONTNEED);
+  }
+#else
+  (void) bytes;
+  (void) length;
+#endif
+}
+
+static void freeSearchIndex(SearchIndex *index) {
+  if (index != NULL) {
+    free(index->starts);
+    free(index->positions);
+    free(index);
+  }
+}
+
+static void releaseBuffer(TJInterpreter *tj, Buffer *buffer) {
+  if (buffer->kind == SHARED_BUFFER || addReferences(tj, &buffer->references, -1) > 0) {
+    return;
+  }
+  freeSearchIndex(buffer->index);
+#ifdef HAVE_MMAP
+  if (buffer->kind == MAPPED_BUFFER) {
+    for (size_t i = 0; i < tj->knownFilesSize; i++) {
+      if (tj->knownFiles[i].buffer == buffer) {
+        tj->knownFiles[i].buffer = NULL;
+      }
+    }
+    munmap(buffer->bytes, buffer->length);
+    for (size_t i = 0; i < tj->mappedFilesSize; i++) {
+      if (tj->mappedFiles[i].buffer == buffer) {
+        free(tj->mappedFiles[i].path);
+        tj->mappedFiles[i] = tj->mappedFiles[--tj->mappedFilesSize];
+        break;
+      }
+    }
+  }
+#endif
+  free(buffer);
+}
+
+static Rope emptyRope = {1, NULL, NULL, NULL, "", 0, 0};
+
+// emptyRope is shared by every interpreter and never written
+static Rope* retainRope(TJInterpreter *tj, Rope *rope) {
+  if (rope != &emptyRope) {
+    addReferences(tj, &rope->references, 1);
+  }
+  return rope;
+}
+
+static void releaseRope(TJInterpreter *tj, Rope *rope) {
+  if (rope == &emptyRope || addReferences(tj, &rope->references, -1) > 0) {
+    return;
+  }
+  if (rope->left != NULL) {
+    releaseRope(tj, rope->left);
+    releaseRope(tj, rope->right);
+  }
+  if (rope->buffer != NULL) {
+    releaseBuffer(tj, rope->buffer);
+  }
+  free(rope);
+}
+
+// Leaf viewing length bytes of buffer starting at bytes
+static Rope* ropeLeaf(TJInterpreter *tj, Buffer *buffer, const char *bytes, size_t length) {
+  if (length == 0) {
+    return &emptyRope;
+  }
+  Rope *rope = allocate(tj, sizeof(Rope));
+  rope->references = 1;
+  rope->left = NULL;
+  rope->right = NULL;
+  rope->buffer = buffer;
+  if (buffer->kind != SHARED_BUFFER) {
+    addReferences(tj, &buffer->references, 1);
+  }
+  rope->bytes = bytes;
+  rope->length = length;
+  rope->depth = 0;
+  return rope;
+}
+
+static Rope* ropeFromBytes(TJInterpreter *tj, const char *bytes, size_t length) {
+  Buffer *buffer = newBuffer(tj, length);
+  memcpy(buffer->bytes, bytes, length);
+  Rope *rope = ropeLeaf(tj, buffer, buffer->bytes, length);
+  if (rope == &emptyRope) {
+    free(buffer);
+  }
+  return rope;
+}
+
+// The rope functions below take over the references they are passed and
+// return a new reference, so a chain of edits never needs extra retains
+
+static Rope* ropeNode(TJInterpreter *tj, Rope *left, Rope *right) {
+  Rope *rope = allocate(tj, sizeof(Rope));
+  rope->references = 1;
+  rope->left = left;
+  rope->right = right;
+  rope->buffer = NULL;
+  rope->bytes = NULL;
+  rope->length = left->length + right->length;
+  rope->depth = 1 + (left->depth > right->depth ? left->depth : right->depth);
+  return rope;
+}
+
+static Rope* rotateLeft(TJInterpreter *tj, Rope *rope) {
+  Rope *a = retainRope(tj, rope->left);
+  Rope *b = retainRope(tj, rope->right->left);
+  Rope *c = retainRope(tj, rope->right->right);
+  releaseRope(tj, rope);
+  return ropeNode(tj, ropeNode(tj, a, b), c);
+}
+
+static Rope* rotateRight(TJInterpreter *tj, Rope *rope) {
+  Rope *a = retainRope(tj, rope->left->left);
+  Rope *b = retainRope(tj, rope->left->right);
+  Rope *c = retainRope(tj, rope->right);
+  releaseRope(tj, rope);
+  return ropeNode(tj, a, ropeNode(tj, b, c));
+}
+
+// AVL join of two balanced ropes, O(difference in depth)
+static Rope* ropeJoin(TJInterpreter *tj, Rope *left, Rope *right) {
+  if (left->depth > right->depth + 1) {
+    Rope *outer = retainRope(tj, left->left);
+    Rope *inner = retainRope(tj, left->right);
+    releaseRope(tj, left);
+    Rope *joined = ropeJoin(tj, inner, right);
+    if (joined->depth <= outer->depth + 1) {
+      return ropeNode(tj, outer, joined);
+    }
+    if (joined->left->depth > joined->right->depth) {
+      joined = rotateRight(tj, joined);
+    }
+    return rotateLeft(tj, ropeNode(tj, outer, joined));
+  }
+  if (right->depth > left->depth + 1) {
+    Rope *inner = retainRope(tj, right->left);
+    Rope *outer = retainRope(tj, right->right);
+    releaseRope(tj, right);
+    Rope *joined = ropeJoin(tj, left, inner);
+    if (joined->depth <= outer->depth + 1) {
+      return ropeNode(tj, joined, outer);
+    }
+    if (joined->right->depth > joined->left->depth) {
+      joined = rotateLeft(tj, joined);
+    }
+    return rotateRight(tj, ropeNode(tj, joined, outer));
+  }
+  return ropeNode(tj, left, right);
+}
+
+// Bytes of a leaf or of a flattened concat node, NULL if not flattened yet.
+// Another thread may be flattening the node right now, see ropeBytes
+static const char* ropeFlatBytes(Rope *rope) {
+#ifdef HAVE_THREADS
+  return __atomic_load_n(&rope->bytes, __ATOMIC_ACQUIRE);
+#else
+  return rope->bytes;
+#endif
+}
+
+static void ropeCopy(Rope *rope, char *destination) {
+  if (ropeFlatBytes(rope) != NULL) {
+    memcpy(destination, rope->bytes, rope->length);
+    return;
+  }
+  ropeCopy(rope->left, destination);
+  ropeCopy(rope->right, destination + rope->left->length);
+}
+
+// Bytes start to end of the rope
+static void ropeCopyRange(Rope *rope, size_t start, size_t end, char *destination) {
+  if (ropeFlatBytes(rope) != NULL) {
+    memcpy(destination, rope->bytes + start, end - start);
+    return;
+  }
+  size_t split = rope->left->length;
+  if (start < split) {
+    ropeCopyRange(rope->left, start, end < split ? end : split, destination);
+  }
+  if (end > split) {
+    ropeCopyRange(rope->right, start > split ? start - split : 0, end - split, destination + (start < split ? split - start : 0));
+  }
+}
+
+//PARALLEL KERNELS
+
+// Searches and copies of KERNEL_THRESHOLD bytes or more are cut into
+// KERNEL_PIECE pieces, taken in order by up to threads threads. Statements
+// run by runParallel already keep every thread busy, so they search and copy
+// on their own thread instead of each starting threads more
+static int kernelThreads(TJInterpreter *tj) {
+#ifdef HAVE_THREADS
+  if (tj->concurrent) {
+    return 1;
+  }
+  return tj->options.threads < KERNEL_THREADS ? tj->options.threads : KERNEL_THREADS;
+#else
+  (void) tj;
+  return 1;
+#endif
+}
+
+// Runs work on count threads, the calling one included, all sharing task.
+// The share of a thread that cannot be started is left to the others
+static void runKernel(int count, void *(*work)(void*), void *task) {
+#ifdef HAVE_THREADS
+  pthread_t threads[KERNEL_THREADS];
+  int started = 0;
+  while (started < count - 1 && pthread_create(&threads[started], NULL, work, task) == 0) {
+    started++;
+  }
+  work(task);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+#else
+  (void) count;
+  work(task);
+#endif
+}
+
+static size_t takePiece(size_t *next) {
+#ifdef HAVE_THREADS
+  return __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+#else
+  return (*next)++;
+#endif
+}
+
+typedef struct {
+  Rope* rope;
+  char* destination;
+  size_t pieces;
+  size_t next;
+} CopyTask;
+
+static void* copyPieces(void *argument) {
+  CopyTask *task = argument;
+  size_t piece;
+  while ((piece = takePiece(&task->next)) < task->pieces) {
+    size_t start = piece * KERNEL_PIECE;
+    size_t end = task->rope->length - start > KERNEL_PIECE ? start + KERNEL_PIECE : task->rope->length;
+    ropeCopyRange(task->rope, start, end, task->destination + start);
+  }
+  return NULL;
+}
+
+static void copyRope(TJInterpreter *tj, Rope *rope, char *destination) {
+  int threads = kernelThreads(tj);
+  if (threads < 2 || rope->length < KERNEL_THRESHOLD) {
+    ropeCopy(rope, destination);
+    return;
+  }
+  CopyTask task = {rope, destination, (rope->length + KERNEL_PIECE - 1) / KERNEL_PIECE, 0};
+  runKernel(threads, copyPieces, &task);
+}
+
+// Contiguous bytes of the rope, not necessarily NUL terminated
+static const char* ropeBytes(TJInterpreter *tj, Rope *rope) {
+  if (ropeFlatBytes(rope) == NULL) {
+    Buffer *buffer = newBuffer(tj, rope->length);
+    buffer->references = 1;
+    copyRope(tj, rope, buffer->bytes);
+#ifdef HAVE_THREADS
+    // The first thread to publish its buffer wins, the others use it
+    if (tj->concurrent) {
+      Buffer *published = NULL;
+      if (!__atomic_compare_exchange_n(&rope->buffer, &published, buffer, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(buffer);
+        return published->bytes;
+      }
+      __atomic_store_n(&rope->bytes, buffer->bytes, __ATOMIC_RELEASE);
+      return buffer->bytes;
+    }
+#endif
+    rope->buffer = buffer;
+    rope->bytes = buffer->bytes;
+  }
+  return rope->bytes;
+}
+
+static Rope* ropeConcat(TJInterpreter *tj, Rope *left, Rope *right) {
+  if (left->length == 0) {
+    releaseRope(tj, left);
+    return right;
+  }
+  if (right->length == 0) {
+    releaseRope(tj, right);
+    return left;
+  }
+  if (left->length + right->length <= ROPE_LEAF_SIZE) {
+    Buffer *buffer = newBuffer(tj, left->length + right->length);
+    ropeCopy(left, buffer->bytes);
+    ropeCopy(right, buffer->bytes + left->length);
+    releaseRope(tj, left);
+    releaseRope(tj, right);
+    return ropeLeaf(tj, buffer, buffer->bytes, buffer->length);
+  }
+  return ropeJoin(tj, left, right);
+}
+
+static void ropeSplit(TJInterpreter *tj, Rope *rope, size_t position, Rope **left, Rope **right) {
+  if (position == 0) {
+    *left = &emptyRope;
+    *right = rope;
+  } else if (position >= rope->length) {
+    *left = rope;
+    *right = &emptyRope;
+  } else if (ropeFlatBytes(rope) != NULL) {
+    *left = ropeLeaf(tj, rope->buffer, rope->bytes, position);
+    *right = ropeLeaf(tj, rope->buffer, rope->bytes + position, rope->length - position);
+    releaseRope(tj, rope);
+  } else {
+    Rope *first = retainRope(tj, rope->left);
+    Rope *second = retainRope(tj, rope->right);
+    size_t boundary = first->length;
+    releaseRope(tj, rope);
+    if (position < boundary) {
+      Rope *rest;
+      ropeSplit(tj, first, position, left, &rest);
+      *right = ropeConcat(tj, rest, second);
+    } else if (position > boundary) {
+      Rope *rest;
+      ropeSplit(tj, second, position - boundary, &rest, right);
+      *left = ropeConcat(tj, first, rest);
+    } else {
+      *left = first;
+      *right = second;
+    }
+  }
+}
+
+static Rope* ropeSlice(TJInterpreter *tj, Rope *rope, size_t start, size_t end) {
+  Rope *left, *middle, *right;
+  ropeSplit(tj, rope, end, &middle, &right);
+  releaseRope(tj, right);
+  ropeSplit(tj, middle, start, &left, &right);
+  releaseRope(tj, left);
+  return right;
+}
+
+// Replaces a TEXT value, dropping the reference to the old rope
+static void setText(TJInterpreter *tj, Value *value, Rope *text) {
+  Rope *old = value->text;
+  value->text = text;
+  releaseRope(tj, old);
+}
+
+#ifndef HAVE_MMAP
+// Write statements without mmap go through stdio
+static void ropeWrite(Rope *rope, FILE *file) {
+  if (ropeFlatBytes(rope) != NULL) {
+    fwrite(rope->bytes, 1, rope->length, file);
+    return;
+  }
+  ropeWrite(rope->left, file);
+  ropeWrite(rope->right, file);
+}
+#endif
+
+// Program output goes to the host's write callback, or stdout without one
+#ifdef HAVE_MMAP
+static bool writeBytes(int fd, const char *bytes, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, bytes, length);
+    if (written < 0) {
+      return false;
+    }
+    bytes += written;
+    length -= written;
+  }
+  return true;
+}
+
+// writev in batches of at most WRITE_VECTORS, finishing short writes
+static bool writeVectors(int fd, struct iovec *vectors, int count) {
+  for (int first = 0; first < count; first += WRITE_VECTORS) {
+    int batch = count - first < WRITE_VECTORS ? count - first : WRITE_VECTORS;
+    ssize_t written = writev(fd, vectors + first, batch);
+    if (written < 0) {
+      return false;
+    }
+    for (int i = first; i < first + batch; i++) {
+      size_t length = vectors[i].iov_len;
+      if ((size_t) written >= length) {
+        written -= length;
+      } else {
+        if (!writeBytes(fd, (char*) vectors[i].iov_base + written, length - written)) {
+          return false;
+        }
+        written = 0;
+      }
+    }
+  }
+  return true;
+}
+
+#endif
+
+//OUTPUT
+
+// Writes the buffered output followed by extra, which is too large to be
+// copied into the buffer. Standard output gets one writev; stdio is flushed
+// first so output the host printed itself stays in order
+static void flushOutput(TJInterpreter *tj, const char *extra, size_t extraLength) {
+  Output *output = tj->output;
+  if (tj->options.host.write != NULL) {
+    if (output->size > 0) {
+      tj->options.host.write(tj->options.host.context, output->bytes, output->size);
+    }
+    if (extraLength > 0) {
+      tj->options.host.write(tj->options.host.context, extra, extraLength);
+    }
+  } else if (output->size > 0 || extraLength > 0) {
+    fflush(stdout);
+#ifdef HAVE_MMAP
+    struct iovec vectors[2] = {{output->bytes, output->size}, {(void*) extra, extraLength}};
+    writeVectors(STDOUT_FILENO, vectors, 2);
+#else
+    fwrite(output->bytes, 1, output->size, stdout);
+    fwrite(extra, 1, extraLength, stdout);
+    fflush(stdout);
+#endif
+  }
+  output->size = 0;
+}
+
+static void writeOutput(TJInterpreter *tj, const char *bytes, size_t length) {
+  Output *output = tj->output;
+  if (output->capacity == 0) {
+    size_t capacity = tj->options.outputBuffer > 0 ? tj->options.outputBuffer : OUTPUT_BUFFER;
+    output->bytes = malloc(capacity);
+    if (output->bytes == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+    output->capacity = capacity;
+  }
+  if (length > output->capacity - output->size) {
+    if (length >= output->capacity) {
+      flushOutput(tj, bytes, length);
+      return;
+    }
+    flushOutput(tj, NULL, 0);
+  }
+  memcpy(output->bytes + output->size, bytes, length);
+  output->size += length;
+  if (tj->options.lineBuffered && memchr(bytes, '\n', length) != NULL) {
+    flushOutput(tj, NULL, 0);
+  }
+}
+
+static void ropeOutput(TJInterpreter *tj, Rope *rope) {
+  if (ropeFlatBytes(rope) != NULL && isStreamed(rope->buffer)) {
+    for (size_t done = 0; done < rope->length; done += STREAM_CHUNK) {
+      size_t length = rope->length - done < STREAM_CHUNK ? rope->length - done : STREAM_CHUNK;
+      writeOutput(tj, rope->bytes + done, length);
+      releasePages(rope->bytes + done, length);
+    }
+    return;
+  }
+  if (ropeFlatBytes(rope) != NULL) {
+    writeOutput(tj, rope->bytes, rope->length);
+    return;
+  }
+  ropeOutput(tj, rope->left);
+  ropeOutput(tj, rope->right);
+}
+
+static size_t scalarSearch(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  const char *end = haystack + n - m + 1;
+  const char *candidate = haystack + start;
+  while (candidate < end) {
+    candidate = memchr(candidate, needle[0], end - candidate);
+    if (candidate == NULL) {
+      return NOT_FOUND;
+    }
+    if (memcmp(candidate + 1, needle + 1, m - 1) == 0) {
+      return candidate - haystack;
+    }
+    candidate++;
+  }
+  return NOT_FOUND;
+}
+
+#ifdef HAVE_SIMD_SEARCH
+// Compares the first and last needle byte against 16 or 32 positions at once
+// and only verifies the positions where both match
+static size_t sse2Search(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+  size_t i = start;
+  for (; i + m + 15 <= n; i += 16) {
+    __m128i blockFirst = _mm_loadu_si128((const __m128i*) (haystack + i));
+    __m128i blockLast = _mm_loadu_si128((const __m128i*) (haystack + i + m - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                    _mm_cmpeq_epi8(last, blockLast)));
+    while (mask != 0) {
+      unsigned bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, m - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return scalarSearch(haystack, n, needle, m, i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2Search(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+  size_t i = start;
+  for (; i + m + 31 <= n; i += 32) {
+    __m256i blockFirst = _mm256_loadu_si256((const __m256i*) (haystack + i));
+    __m256i blockLast = _mm256_loadu_si256((const __m256i*) (haystack + i + m - 1));
+    unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                                                                     _mm256_cmpeq_epi8(last, blockLast)));
+    while (mask != 0) {
+      unsigned bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, m - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return sse2Search(haystack, n, needle, m, i);
+}
+#endif
+
+// Maximal suffix of needle under the normal or the reversed byte order,
+// used by the critical factorization of the Two-Way algorithm
+static ptrdiff_t maximalSuffix(const unsigned char *needle, ptrdiff_t m, ptrdiff_t *period, bool reversed) {
+  ptrdiff_t suffix = -1, j = 0, k = 1;
+  *period = 1;
+  while (j + k < m) {
+    unsigned char a = needle[j + k];
+    unsigned char b = needle[suffix + k];
+    if (reversed ? a > b : a < b) {
+      j += k;
+      k = 1;
+      *period = j - suffix;
+    } else if (a == b) {
+      if (k != *period) {
+        k++;
+      } else {
+        j += *period;
+        k = 1;
+      }
+    } else {
+      suffix = j;
+      j = suffix + 1;
+      k = *period = 1;
+    }
+  }
+  return suffix;
+}
+
+// Crochemore-Perrin Two-Way search: linear time and constant space, which
+// keeps long needles from degrading into O(n*m)
+static size_t twoWaySearch(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  const unsigned char *x = (const unsigned char*) needle;
+  const unsigned char *y = (const unsigned char*) haystack + start;
+  ptrdiff_t length = (ptrdiff_t) m;
+  ptrdiff_t limit = (ptrdiff_t) (n - start) - length;
+  ptrdiff_t p, q, ell, period;
+  ptrdiff_t i = maximalSuffix(x, length, &p, false);
+  ptrdiff_t j = maximalSuffix(x, length, &q, true);
+  if (i > j) {
+    ell = i;
+    period = p;
+  } else {
+    ell = j;
+    period = q;
+  }
+  if (memcmp(x, x + period, ell + 1) == 0) {
+    ptrdiff_t memory = -1;
+    j = 0;
+    while (j <= limit) {
+      i = (ell > memory ? ell : memory) + 1;
+      while (i < length && x[i] == y[i + j]) {
+        i++;
+      }
+      if (i >= length) {
+        i = ell;
+        while (i > memory && x[i] == y[i + j]) {
+          i--;
+        }
+        if (i <= memory) {
+          return start + j;
+        }
+        j += period;
+        memory = length - period - 1;
+      } else {
+        j += i - ell;
+        memory = -1;
+      }
+    }
+  } else {
+    period = (ell + 1 > length - ell - 1 ? ell + 1 : length - ell - 1) + 1;
+    j = 0;
+    while (j <= limit) {
+      i = ell + 1;
+      while (i < length && x[i] == y[i + j]) {
+        i++;
+      }
+      if (i >= length) {
+        i = ell;
+        while (i >= 0 && x[i] == y[i + j]) {
+          i--;
+        }
+        if (i < 0) {
+          return start + j;
+        }
+        j += period;
+      } else {
+        j += i - ell;
+      }
+    }
+  }
+  return NOT_FOUND;
+}
+
+// First occurrence of needle at or after start, NOT_FOUND otherwise
+static size_t searchText(const char *haystack, size_t n, const char *needle, size_t m, size_t start) {
+  if (start > n || m > n - start) {
+    return NOT_FOUND;
+  }
+  if (m == 0) {
+    return start;
+  }
+  if (m == 1) {
+    const char *found = memchr(haystack + start, needle[0], n - start);
+    return found == NULL ? NOT_FOUND : (size_t) (found - haystack);
+  }
+  if (m > SHORT_NEEDLE) {
+    return twoWaySearch(haystack, n, needle, m, start);
+  }
+#ifdef HAVE_SIMD_SEARCH
+  if (__builtin_cpu_supports("avx2")) {
+    return avx2Search(haystack, n, needle, m, start);
+  }
+  return sse2Search(haystack, n, needle, m, start);
+#else
+  return scalarSearch(haystack, n, needle, m, start);
+#endif
+}
+
+static uint32_t gramBucket(const char *bytes, int shift) {
+  uint32_t gram;
+  memcpy(&gram, bytes, 4);
+  return (gram * 2654435761u) >> shift;
+}
+
+// Two counting passes over the buffer; NULL if it is out of memory
+static SearchIndex* buildSearchIndex(TJInterpreter *tj, Buffer *buffer) {
+  size_t grams = buffer->length - 3;
+  int bits = 10;
+  while (bits < 22 && ((size_t) 8 << bits) < grams) {
+    bits++;
+  }
+  size_t buckets = (size_t) 1 << bits;
+  SearchIndex *index = malloc(sizeof(SearchIndex));
+  uint32_t *starts = calloc(buckets + 1, sizeof(uint32_t));
+  uint32_t *positions = malloc(grams * sizeof(uint32_t));
+  if (index == NULL || starts == NULL || positions == NULL) {
+    free(index);
+    free(starts);
+    free(positions);
+    return NULL;
+  }
+  tj->bytesAllocated += sizeof(SearchIndex) + (buckets + 1 + grams) * sizeof(uint32_t);
+  index->shift = 32 - bits;
+  for (size_t i = 0; i < grams; i++) {
+    starts[gramBucket(buffer->bytes + i, index->shift) + 1]++;
+  }
+  for (size_t i = 0; i < buckets; i++) {
+    starts[i + 1] += starts[i];
+  }
+  // starts[b] moves to the end of bucket b while filling and back after
+  for (size_t i = 0; i < grams; i++) {
+    positions[starts[gramBucket(buffer->bytes + i, index->shift)]++] = (uint32_t) i;
+  }
+  for (size_t i = buckets; i > 0; i--) {
+    starts[i] = starts[i - 1];
+  }
+  starts[0] = 0;
+  index->starts = starts;
+  index->positions = positions;
+  return index;
+}
+
+// Shared buffers are read by other interpreters and streamed ones would need
+// an index four times their size, so neither is indexed
+static bool isIndexable(TJInterpreter *tj, Buffer *buffer) {
+  return !tj->concurrent && buffer != NULL && buffer->kind != SHARED_BUFFER
+      && buffer->length >= INDEX_MIN_LENGTH && buffer->length < STREAM_THRESHOLD;
+}
+
+// Building an index costs about as much as scanning the buffer INDEX_SCANS
+// times, so it is built once scans of it have added up to that
+static void countScan(TJInterpreter *tj, Rope *rope, size_t scanned) {
+  Buffer *buffer = rope->buffer;
+  if (!isIndexable(tj, buffer) || buffer->index != NULL) {
+    return;
+  }
+  buffer->scanned += scanned;
+  if (buffer->scanned >= INDEX_SCANS * buffer->length) {
+    buffer->index = buildSearchIndex(tj, buffer);
+    buffer->scanned = 0;
+  }
+}
+
+// The needle's rarest gram gives the candidates: a binary search finds the
+// first one at or after start, and they are checked in order. False when
+// the buffer has no index or no gram is selective enough, so the caller
+// scans instead
+static bool searchIndexed(TJInterpreter *tj, Rope *rope, const char *needle, size_t m, size_t start, size_t *found) {
+  Buffer *buffer = rope->buffer;
+  if (m < 4 || !isIndexable(tj, buffer) || buffer->index == NULL) {
+    return false;
+  }
+  SearchIndex *index = buffer->index;
+  size_t rarest = 0;
+  uint32_t first = 0, last = UINT32_MAX;
+  for (size_t offset = 0; offset + 4 <= m && offset < 256; offset++) {
+    uint32_t bucket = gramBucket(needle + offset, index->shift);
+    if (index->starts[bucket + 1] - index->starts[bucket] < last - first) {
+      rarest = offset;
+      first = index->starts[bucket];
+      last = index->starts[bucket + 1];
+    }
+  }
+  if (last - first > buffer->length / 16) {
+    return false;
+  }
+  size_t base = (size_t) (rope->bytes - buffer->bytes);
+  size_t lowest = base + start + rarest;
+  uint32_t end = last;
+  while (first < last) {
+    uint32_t middle = first + (last - first) / 2;
+    if (index->positions[middle] < lowest) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  for (; first < end; first++) {
+    size_t candidate = index->positions[first] - rarest;
+    if (candidate + m > base + rope->length) {
+      break;
+    }
+    if (memcmp(buffer->bytes + candidate, needle, m) == 0) {
+      *found = candidate - base;
+      return true;
+    }
+  }
+  *found = NOT_FOUND;
+  return true;
+}
+
+static bool loadSource(TJInterpreter *tj, const char *file) {
+  FILE *sourceFile = fopen(file, "rb");
+  if (sourceFile == NULL) {
+    return false;
+  }
+  // Pipes and files that report no size are read until end of file
+  long size = -1;
+  if (fseek(sourceFile, 0, SEEK_END) == 0) {
+    size = ftell(sourceFile);
+    if (fseek(sourceFile, 0, SEEK_SET) != 0) {
+      size = -1;
+    }
+  }
+  size_t capacity = size > 0 ? (size_t) size : 65536;
+  size_t length = 0;
+  char *source = malloc(capacity + SOURCE_PADDING);
+  while (source != NULL) {
+    length += fread(source + length, 1, capacity - length, sourceFile);
+    if (length < capacity || size > 0) {
+      break;
+    }
+    char *grown = realloc(source, capacity * 2 + SOURCE_PADDING);
+    if (grown == NULL) {
+      free(source);
+    }
+    source = grown;
+    capacity *= 2;
+  }
+  fclose(sourceFile);
+  if (source == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  memset(source + length, 0, SOURCE_PADDING);
+  tj->source = source;
+  tj->cursor = tj->source;
+  tj->sourceEnd = tj->source + length;
+  return true;
+}
+
+static const char* skipWhitespace(const char *p) {
+#ifdef HAVE_SIMD_SEARCH
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+  const __m128i aboveReturn = _mm_set1_epi8('\r' + 1);
+  for (;;) {
+    __m128i block = _mm_loadu_si128((const __m128i*) p);
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(block, belowTab), _mm_cmplt_epi8(block, aboveReturn));
+    unsigned mask = ~_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, space), control)) & 0xFFFF;
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#else
+  while (isspace((unsigned char) *p)) {
+    p++;
+  }
+  return p;
+#endif
+}
+
+static const char* skipComment(TJInterpreter *tj, const char *p) {
+  if (p[1] != '*') {
+    raiseError(tj, "Unrecognized character: '/'");
+  }
+  size_t end = searchText(p + 2, tj->sourceEnd - (p + 2), "*/", 2, 0);
+  if (end == NOT_FOUND) {
+    raiseError(tj, "Comment cannot be terminated!");
+  }
+  return p + 2 + end + 2;
+}
+
+// Perfect hash over the keyword set: (first * 2 + last * 3 + length) % 64
+// has no collisions, so a lookup is one hash and one comparison
+static const char* KEYWORD_TABLE[KEYWORD_SLOTS] = {
+  [0] = "output", [3] = "subs", [4] = "new", [6] = "times", [8] = "text", [13] = "locate",
+  [20] = "read", [21] = "override", [23] = "from", [25] = "size", [34] = "write", [36] = "asText",
+  [44] = "loop", [49] = "int", [51] = "input", [52] = "insert", [55] = "to", [57] = "end", [63] = "asString"
+};
+
+static bool isKeyword (const char *str, size_t length) {
+  unsigned slot = ((unsigned char) str[0] * 2 + (unsigned char) str[length - 1] * 3 + length) % KEYWORD_SLOTS;
+  const char *keyword = KEYWORD_TABLE[slot];
+  return keyword != NULL && strlen(keyword) == length && memcmp(keyword, str, length) == 0;
+}
+
+static char isOperator (TJInterpreter *tj, char ch) {
+  if (ch == '+' || ch == '-') { return ch; }
+  if (ch == ':') {
+    if (tj->cursor[1] == '=') {
+      tj->cursor++;
+      return '=';
+    }
+    raiseError(tj, "Invalid operator, assignment operator must be used like ':='");
+  }
+  return '\0';
+}
+
+static Token getNextToken(TJInterpreter *tj) {
+  Token token;
+  token.length = 0;
+
+  //SKIP WHITESPACE and COMMENT
+  tj->cursor = skipWhitespace(tj->cursor);
+  while (*tj->cursor == '/') {
+    tj->cursor = skipComment(tj, tj->cursor);
+    tj->cursor = skipWhitespace(tj->cursor);
+  }
+  if (tj->cursor >= tj->sourceEnd) {
+    token.type = ENDOFFILE;
+    token.lexeme = "";
+    return token;
+  }
+  char ch = *tj->cursor;
+
+  //IDENTIFIER
+  if (isalpha((unsigned char) ch)) { // Starts with letter
+    const char *start = tj->cursor;
+    while (isalnum((unsigned char) *tj->cursor) || *tj->cursor == '_') {
+      tj->cursor++;
+    }
+    size_t length = tj->cursor - start;
+    if (length > MAX_IDENT_LENGTH) {
+      char errMessage[64];
+      sprintf(errMessage, "Identifiers must be smaller or equal than %d characters!", MAX_IDENT_LENGTH);
+      raiseError(tj, errMessage);
+    }
+    token.lexeme = arenaAlloc(tj, length + 1);
+    memcpy(token.lexeme, start, length);
+    token.lexeme[length] = '\0'; //null terminator, marks the end of a string
+    token.length = length;
+    token.type = isKeyword(start, length) ? KEYWORD : IDENTIFIER;
+    return token;
+  }
+
+  //INTEGER
+  if (isdigit((unsigned char) ch)) {
+    unsigned long long value = 0;
+    while (isdigit((unsigned char) *tj->cursor)) {
+      value = value * 10 + (*tj->cursor - '0');
+      if(value > 4294967295 ) {
+        raiseError(tj, "Integer value is too big!");
+      }
+      tj->cursor++;
+    }
+    if (isalpha((unsigned char) *tj->cursor) || *tj->cursor == '_') {
+      raiseError(tj, "Invalid identifier, identifiers cannot start with a number!");
+    }
+    token.lexeme = arenaAlloc(tj, 21);
+    sprintf(token.lexeme, "%llu", value);
+    token.type = INT_CONST;
+    return token;
+  }
+
+  //OPERATOR
+  char operator = isOperator(tj, ch);
+  tj->cursor++;
+  if (operator != '\0') {
+    token.type = OPERATOR;
+    token.lexeme = operator == '+' ? "+" : operator == '-' ? "-" : "=";
+    return token;
+  }
+
+  //PARENTHESIS_OPEN
+  if (ch == '(') {
+    token.type = PARENTHESIS_OPEN;
+    token.lexeme = "(";
+    return token;
+  }
+
+  //PARENTHESIS_CLOSE
+  if (ch == ')') {
+    token.type = PARENTHESIS_CLOSE;
+    token.lexeme = ")";
+    return token;
+  }
+
+  //COMMA
+  if (ch == ',') {
+    token.type = COMMA;
+    token.lexeme = ",";
+    return token;
+  }
+
+  //STRING CONSTANT
+  if (ch == '"') {
+    const char *end = memchr(tj->cursor, '"', tj->sourceEnd - tj->cursor);
+    if (end == NULL) {
+      raiseError(tj, "String cannot terminated!");
+    }
+    size_t length = end - tj->cursor;
+    token.lexeme = arenaAlloc(tj, length + 1);
+    memcpy(token.lexeme, tj->cursor, length);
+    token.lexeme[length] = '\0';
+    token.length = length;
+    token.type = STR_CONST;
+    tj->cursor = end + 1;
+    return token;
+  }
+
+  //ENDOFLINE
+  if (ch == ';') {
+    token.type = ENDOFLINE;
+    token.lexeme = "";
+    return token;
+  }
+
+  char errMessage[50];
+  sprintf(errMessage, "Unrecognized character: '%c'!", ch);
+  raiseError(tj, errMessage);
+}
+
+static char* copyString(TJInterpreter *tj, const char *string) {
+  char *copy = calloc(strlen(string) + 1, sizeof(char));
+  if (copy == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  strcpy(copy, string);
+  return copy;
+}
+
+static int addVariable(TJInterpreter *tj, const char *name, Value value) {
+  if (tj->variablesSize == tj->variablesCapacity) {
+    tj->variablesCapacity = tj->variablesCapacity == 0 ? 16 : tj->variablesCapacity * 2;
+    tj->variables = realloc(tj->variables, tj->variablesCapacity * sizeof(Variable));
+    if (tj->variables == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  Variable *variable = &tj->variables[tj->variablesSize];
+  variable->name = name;
+  variable->value = value;
+  return (int) tj->variablesSize++;
+}
+
+static int addIntConstant(TJInterpreter *tj, const char *lexeme) {
+  Value value = {INT, .number = strtoll(lexeme, NULL, 10)};
+  return addVariable(tj, NULL, value);
+}
+
+static int addTextConstant(TJInterpreter *tj, const char *text, size_t length) {
+  Value value = {TEXT, .text = ropeFromBytes(tj, text, length)};
+  return addVariable(tj, NULL, value);
+}
+
+static void appendInstruction(TJInterpreter *tj, Instruction instruction) {
+  if (tj->program.size == tj->program.capacity) {
+    tj->program.capacity = tj->program.capacity == 0 ? 64 : tj->program.capacity * 2;
+    tj->program.code = realloc(tj->program.code, tj->program.capacity * sizeof(Instruction));
+    if (tj->program.code == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  tj->program.code[tj->program.size++] = instruction;
+}
+
+static void emit(TJInterpreter *tj, OpCode op, int a, int b, int c, int d) {
+  Instruction instruction = {op, tj->currentLine, a, b, c, d};
+  appendInstruction(tj, instruction);
+}
+
+// Stores an operand list for OP_JOIN and returns where it starts
+static int addOperands(TJInterpreter *tj, int *slots, int count) {
+  while (tj->program.operandsSize + count > tj->program.operandsCapacity) {
+    tj->program.operandsCapacity = tj->program.operandsCapacity == 0 ? 64 : tj->program.operandsCapacity * 2;
+    tj->program.operands = realloc(tj->program.operands, tj->program.operandsCapacity * sizeof(int));
+    if (tj->program.operands == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  memcpy(tj->program.operands + tj->program.operandsSize, slots, count * sizeof(int));
+  tj->program.operandsSize += count;
+  return (int) (tj->program.operandsSize - count);
+}
+
+// Statement scratch slots, reused by every statement: index 0 accumulates
+// an expression, the rest hold results of builtin calls inside it
+static int getTemporary(TJInterpreter *tj, DataType type, int index) {
+  if (index == tj->temporariesSize[type]) {
+    tj->temporaries[type] = realloc(tj->temporaries[type], (index + 1) * sizeof(int));
+    if (tj->temporaries[type] == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+    Value value = {.type = type};
+    if (type == TEXT) {
+      value.text = &emptyRope;
+    }
+    tj->temporaries[type][tj->temporariesSize[type]++] = addVariable(tj, "", value);
+  }
+  return tj->temporaries[type][index];
+}
+
+static uint32_t hashName(const char *name) {
+  uint32_t hash = 2166136261u;
+  while (*name != '\0') {
+    hash = (hash ^ (unsigned char) *name++) * 16777619u;
+  }
+  return hash;
+}
+
+static void growSymbols(TJInterpreter *tj) {
+  size_t oldCapacity = tj->symbolsCapacity;
+  Symbol *oldSymbols = tj->symbols;
+  tj->symbolsCapacity = oldCapacity == 0 ? 64 : oldCapacity * 2;
+  tj->symbols = calloc(tj->symbolsCapacity, sizeof(Symbol));
+  if (tj->symbols == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (oldSymbols[i].name != NULL) {
+      size_t slot = oldSymbols[i].hash & (tj->symbolsCapacity - 1);
+      while (tj->symbols[slot].name != NULL) {
+        slot = (slot + 1) & (tj->symbolsCapacity - 1);
+      }
+      tj->symbols[slot] = oldSymbols[i];
+    }
+  }
+  free(oldSymbols);
+}
+
+// Open addressing with linear probing; the table is kept at most 3/4 full
+static Symbol* internSymbol(TJInterpreter *tj, const char *name) {
+  if ((tj->symbolsSize + 1) * 4 > tj->symbolsCapacity * 3) {
+    growSymbols(tj);
+  }
+  uint32_t hash = hashName(name);
+  size_t slot = hash & (tj->symbolsCapacity - 1);
+  while (tj->symbols[slot].name != NULL) {
+    if (tj->symbols[slot].hash == hash && strcmp(tj->symbols[slot].name, name) == 0) {
+      return &tj->symbols[slot];
+    }
+    slot = (slot + 1) & (tj->symbolsCapacity - 1);
+  }
+  Symbol *symbol = &tj->symbols[slot];
+  symbol->name = copyString(tj, name);
+  symbol->hash = hash;
+  symbol->variable = -1;
+  tj->symbolsSize++;
+  return symbol;
+}
+
+static void parseDeclaration(TJInterpreter *tj, Token *line) {
+  if (line[1].type != KEYWORD || line[2].type != IDENTIFIER || line[3].type != NO_TYPE) {
+    raiseError(tj, "Invalid variable initialization");
+  }
+
+  DataType type;
+  if (strcmp(line[1].lexeme, "int") == 0) {
+    type = INT;
+  } else if (strcmp(line[1].lexeme, "text") == 0) {
+    type = TEXT;
+  } else {
+    char errMessage[50];
+    sprintf(errMessage, "Unrecognized type: %s!", line[1].lexeme);
+    raiseError(tj, errMessage);
+  }
+  Symbol *symbol = internSymbol(tj, line[2].lexeme);
+  // A repeated declaration is ignored, the first one stays visible
+  if (symbol->variable < 0) {
+    Value value = {.type = type};
+    if (type == TEXT) {
+      value.text = &emptyRope;
+    }
+    symbol->variable = addVariable(tj, symbol->name, value);
+  }
+}
+
+static int getVariable(TJInterpreter *tj, char *name) {
+  Symbol *symbol = internSymbol(tj, name);
+  if (symbol->variable >= 0) {
+    return symbol->variable;
+  }
+  char errMessage[64];
+  sprintf(errMessage, "Variable not found: %s!", name);
+  raiseError(tj, errMessage);
+}
+
+static int getTypedVariable(TJInterpreter *tj, char *name, DataType type, char *message) {
+  int index = getVariable(tj, name);
+  if (tj->variables[index].value.type != type) {
+    raiseError(tj, message);
+  }
+  return index;
+}
+
+static int addFileNameConstant(TJInterpreter *tj, Token token) {
+  char fileName[MAX_IDENT_LENGTH + 5];
+  memcpy(fileName, token.lexeme, token.length);
+  memcpy(fileName + token.length, ".txt", 5);
+  return addTextConstant(tj, fileName, token.length + 4);
+}
+
+static void parseOutput(TJInterpreter *tj, Token *line) {
+  if (line[1].type != IDENTIFIER || line[2].type != NO_TYPE) {
+    raiseError(tj, "Invalid output statement!");
+  }
+  emit(tj, OP_OUTPUT, getVariable(tj, line[1].lexeme), 0, 0, 0);
+}
+
+static void parseInput(TJInterpreter *tj, Token *line) {
+  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
+    raiseError(tj, "Invalid input!");
+  }
+  if (strcmp(line[2].lexeme, "prompt") != 0) {
+    raiseError(tj, "Invalid input!");
+  }
+  int prompt = getVariable(tj, line[3].lexeme);
+  emit(tj, OP_INPUT, getVariable(tj, line[1].lexeme), prompt, 0, 0);
+}
+
+static void parseRead(TJInterpreter *tj, Token *line) {
+  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
+    raiseError(tj, "Invalid read!");
+  }
+  if (line[2].type != KEYWORD || strcmp(line[2].lexeme, "from") != 0) {
+    raiseError(tj, "Invalid read!");
+  }
+  int variable = getVariable(tj, line[1].lexeme);
+  emit(tj, OP_READ, variable, addFileNameConstant(tj, line[3]), 0, 0);
+}
+
+static void parseWrite(TJInterpreter *tj, Token *line) {
+  if (line[1].type != IDENTIFIER || line[3].type != IDENTIFIER || line[4].type != NO_TYPE) {
+    raiseError(tj, "Invalid write!");
+  }
+  if (line[2].type != KEYWORD || strcmp(line[2].lexeme, "to") != 0) {
+    raiseError(tj, "Invalid write!");
+  }
+  int variable = getVariable(tj, line[1].lexeme);
+  emit(tj, OP_WRITE, variable, addFileNameConstant(tj, line[3]), 0, 0);
+}
+
+// `loop count times;` runs the statements up to the matching `end;` count
+// times, count being read once when the loop starts. Every loop has its own
+// counter slot
+static void parseLoop(TJInterpreter *tj, Token *line) {
+  if (line[2].type != KEYWORD || strcmp(line[2].lexeme, "times") != 0 || line[3].type != NO_TYPE) {
+    raiseError(tj, "Invalid loop!");
+  }
+  int count;
+  if (line[1].type == INT_CONST) {
+    count = addIntConstant(tj, line[1].lexeme);
+  } else if (line[1].type == IDENTIFIER) {
+    count = getTypedVariable(tj, line[1].lexeme, INT, "Invalid loop!");
+  } else {
+    raiseError(tj, "Invalid loop!");
+  }
+  Value zero = {INT, .number = 0};
+  emit(tj, OP_LOOP, addVariable(tj, "", zero), count, 0, 0);
+}
+
+static void parseLoopEnd(TJInterpreter *tj, Token *line) {
+  if (line[1].type != NO_TYPE) {
+    raiseError(tj, "Invalid loop end!");
+  }
+  emit(tj, OP_END_LOOP, 0, 0, 0, 0);
+}
+
+// Pairs every OP_LOOP with its OP_END_LOOP, again after each pass that
+// moves instructions. Loops still open are chained through their c
+static void linkLoops(TJInterpreter *tj) {
+  Instruction *code = tj->program.code;
+  int open = -1;
+  for (size_t i = 0; i < tj->program.size; i++) {
+    if (code[i].op == OP_LOOP) {
+      code[i].c = open;
+      open = (int) i;
+    } else if (code[i].op == OP_END_LOOP) {
+      if (open < 0) {
+        tj->currentLine = code[i].line;
+        raiseError(tj, "Invalid loop end!");
+      }
+      int loop = open;
+      open = code[loop].c;
+      code[loop].c = (int) i;
+      code[i].a = code[loop].a;
+      code[i].b = loop;
+    }
+  }
+  if (open >= 0) {
+    tj->currentLine = code[open].line;
+    raiseError(tj, "Loop is not closed!");
+  }
+}
+
+static void parseAssignment(TJInterpreter *tj, Token *line) {
+  if (line[0].type != IDENTIFIER) {
+    raiseError(tj, "Invalid assignment!");
+  }
+  int variable = getVariable(tj, line[0].lexeme);
+  DataType type = tj->variables[variable].value.type;
+  if (line[2].type == INT_CONST){
+    if (type != INT) {
+      raiseError(tj, "Invalid assignment!");
+    }
+    emit(tj, OP_MOVE, variable, addIntConstant(tj, line[2].lexeme), 0, 0);
+  } else if (line[2].type == STR_CONST){
+    if (type != TEXT) {
+      raiseError(tj, "Invalid assignment!");
+    }
+    emit(tj, OP_MOVE, variable, addTextConstant(tj, line[2].lexeme, line[2].length), 0, 0);
+  } else if (line[2].type == IDENTIFIER) {
+    emit(tj, OP_MOVE, variable, getTypedVariable(tj, line[2].lexeme, type, "Invalid assignment!"), 0, 0);
+  } else {
+    raiseError(tj, "Invalid assignment!");
+  }
+}
+
+// Builtins borrow their arguments and return a new reference
+
+static int64_t sizeFunc(Rope *text) {
+  return (int64_t) text->length;
+}
+
+static Rope* subsFunc(TJInterpreter *tj, Rope *text, int64_t start, int64_t end) {
+  int64_t length = (int64_t) text->length;
+  if (end > length) { end = length; }
+  if (start < 0 || start > end) { start = end; }
+  return ropeSlice(tj, retainRope(tj, text), start, end);
+}
+
+// text + subs(source, start, end) for OP_APPEND_SUBS: a short result is
+// copied straight into one leaf and a flat source is sliced with a single
+// leaf, instead of splitting the source and concatenating the slice
+static Rope* appendSubsFunc(TJInterpreter *tj, Rope *text, Rope *source, int64_t start, int64_t end) {
+  int64_t length = (int64_t) source->length;
+  if (end > length) { end = length; }
+  if (start < 0 || start > end) { start = end; }
+  size_t count = (size_t) (end - start);
+  if (count == 0) {
+    return retainRope(tj, text);
+  }
+  if (text->length + count <= ROPE_LEAF_SIZE) {
+    Buffer *buffer = newBuffer(tj, text->length + count);
+    ropeCopy(text, buffer->bytes);
+    ropeCopyRange(source, start, end, buffer->bytes + text->length);
+    return ropeLeaf(tj, buffer, buffer->bytes, buffer->length);
+  }
+  const char *bytes = ropeFlatBytes(source);
+  Rope *slice = bytes != NULL ? ropeLeaf(tj, source->buffer, bytes + start, count) : subsFunc(tj, source, start, end);
+  return ropeConcat(tj, retainRope(tj, text), slice);
+}
+
+// The earliest match any thread has found; pieces are taken in order, so
+// a thread taking a piece past it can stop
+typedef struct {
+  const char* bytes;
+  size_t n;
+  const char* needle;
+  size_t m;
+  size_t start;
+  bool release;
+  size_t pieces;
+  size_t next;
+  size_t found;
+} SearchTask;
+
+static size_t loadFound(SearchTask *task) {
+#ifdef HAVE_THREADS
+  return __atomic_load_n(&task->found, __ATOMIC_RELAXED);
+#else
+  return task->found;
+#endif
+}
+
+static void lowerFound(SearchTask *task, size_t found) {
+#ifdef HAVE_THREADS
+  size_t current = __atomic_load_n(&task->found, __ATOMIC_RELAXED);
+  while (found < current
+         && !__atomic_compare_exchange_n(&task->found, &current, found, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+#else
+  if (found < task->found) {
+    task->found = found;
+  }
+#endif
+}
+
+// Consecutive pieces overlap by m - 1 bytes, so matches across their
+// boundary are found
+static void* searchPieces(void *argument) {
+  SearchTask *task = argument;
+  size_t piece;
+  while ((piece = takePiece(&task->next)) < task->pieces) {
+    size_t from = task->start + piece * KERNEL_PIECE;
+    if (from >= loadFound(task)) {
+      break;
+    }
+    size_t to = task->n - from > KERNEL_PIECE + task->m - 1 ? from + KERNEL_PIECE + task->m - 1 : task->n;
+    size_t found = searchText(task->bytes, to, task->needle, task->m, from);
+    if (task->release) {
+      releasePages(task->bytes + from, to - from);
+    }
+    if (found != NOT_FOUND) {
+      lowerFound(task, found);
+    }
+  }
+  return NULL;
+}
+
+// searchText for bytes viewed from buffer. Long ranges are searched in
+// pieces across threads, and streamed buffers piece by piece so their pages
+// can be released
+static size_t searchLarge(TJInterpreter *tj, Buffer *buffer, const char *bytes, size_t n, const char *needle, size_t m,
+                   size_t start) {
+  bool streamed = isStreamed(buffer);
+  int threads = kernelThreads(tj);
+  if (start > n || m > n - start || (!streamed && (threads < 2 || n - start < KERNEL_THRESHOLD))) {
+    return searchText(bytes, n, needle, m, start);
+  }
+  size_t pieces = (n - start - m) / KERNEL_PIECE + 1;
+  SearchTask task = {bytes, n, needle, m, start, streamed, pieces, 0, NOT_FOUND};
+  runKernel(n - start < KERNEL_THRESHOLD ? 1 : threads, searchPieces, &task);
+  return task.found;
+}
+
+// State of a search through the leaves of a rope. window holds the last
+// bytes before offset that could still begin a match, at most m - 1 of
+// them, starting at text offset windowStart
+typedef struct {
+  TJInterpreter* tj;
+  const char* needle;
+  size_t m;
+  size_t start;
+  size_t offset;
+  char* window;
+  size_t windowSize;
+  size_t windowStart;
+  size_t found;
+} RopeSearch;
+
+static bool searchLeaf(RopeSearch *search, Buffer *buffer, const char *bytes, size_t length) {
+  size_t m = search->m;
+  size_t offset = search->offset;
+  search->offset += length;
+  // Matches that begin in the window and end in this leaf come first
+  size_t prefix = length < m - 1 ? length : m - 1;
+  if (search->windowSize > 0) {
+    memcpy(search->window + search->windowSize, bytes, prefix);
+    size_t combined = search->windowSize + prefix;
+    size_t from = search->start > search->windowStart ? search->start - search->windowStart : 0;
+    size_t found = searchText(search->window, combined, search->needle, m, from);
+    if (found != NOT_FOUND && found < search->windowSize) {
+      search->found = search->windowStart + found;
+      return true;
+    }
+    if (length < m - 1) {
+      size_t keep = combined < m - 1 ? combined : m - 1;
+      memmove(search->window, search->window + combined - keep, keep);
+      search->windowSize = keep;
+      search->windowStart = search->offset - keep;
+      return false;
+    }
+  }
+  size_t from = search->start > offset ? search->start - offset : 0;
+  size_t found = searchLarge(search->tj, buffer, bytes, length, search->needle, m, from);
+  if (found != NOT_FOUND) {
+    search->found = offset + found;
+    return true;
+  }
+  size_t keep = length < m - 1 ? length : m - 1;
+  memcpy(search->window, bytes + length - keep, keep);
+  search->windowSize = keep;
+  search->windowStart = search->offset - keep;
+  return false;
+}
+
+static bool searchLeaves(TJInterpreter *tj, Rope *rope, RopeSearch *search) {
+  if (search->offset + rope->length <= search->start) {
+    search->offset += rope->length;
+    search->windowSize = 0;
+    return false;
+  }
+  if (ropeFlatBytes(rope) != NULL) {
+    return searchLeaf(search, rope->buffer, rope->bytes, rope->length);
+  }
+  return searchLeaves(tj, rope->left, search) || searchLeaves(tj, rope->right, search);
+}
+
+// First occurrence of needle at or after start. Texts below STREAM_THRESHOLD
+// are flattened once and searched in place; larger ones are searched leaf
+// by leaf, so an edited huge file is never copied
+static size_t searchRope(TJInterpreter *tj, Rope *rope, const char *needle, size_t m, size_t start) {
+  size_t n = rope->length;
+  if (start > n || m > n - start) {
+    return NOT_FOUND;
+  }
+  if (m == 0) {
+    return start;
+  }
+  if (n < STREAM_THRESHOLD || ropeFlatBytes(rope) != NULL) {
+    const char *bytes = ropeBytes(tj, rope);
+    return searchLarge(tj, rope->buffer, bytes, n, needle, m, start);
+  }
+  RopeSearch search = {tj, needle, m, start, 0, malloc(2 * m), 0, 0, NOT_FOUND};
+  if (search.window == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  searchLeaves(tj, rope, &search);
+  free(search.window);
+  return search.found;
+}
+
+static int64_t locateFunc(const char* bigText, size_t bigLen, const char* smallText, size_t smallLen, int64_t start) {
+  if (start < 0 || (uint64_t) start >= bigLen) {
+    return 0;
+  }
+  size_t found = searchText(bigText, bigLen, smallText, smallLen, (size_t) start);
+  return found == NOT_FOUND ? 0 : (int64_t) found;
+}
+
+//RESULT CACHE
+
+// With options.results set, searches of texts of RESULT_MIN_BYTES or
+// more (locate and text -) for needles of up to RESULT_NEEDLE bytes are
+// looked up by the content of text and needle and the start position before
+// they run. The other builtins take constant or logarithmic time on ropes,
+// less than hashing their operands would. The table is read from
+// <dir>/results.tjr when a run starts and written back, merged with what
+// other runs saved meanwhile, when it ends. The hashes of files read are
+// saved with it, so a hit on a file that has not changed costs no pass over
+// its bytes.
+#define RESULTS_MAGIC     0x43524a54u // "TJRC"
+#define RESULTS_VERSION   2
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t count;
+  uint64_t files;
+  uint64_t checksum; // of the entries, then the files
+} ResultsHeader;
+
+static uint64_t hashWords(uint64_t hash, const char *bytes, size_t length) {
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15u;
+    hash ^= hash >> 29;
+  }
+  for (; i < length; i++) {
+    hash = (hash ^ (unsigned char) bytes[i]) * 1099511628211u;
+  }
+  return hash;
+}
+
+static uint64_t hashLeaf(uint64_t hash, Buffer *buffer, const char *bytes, size_t length) {
+  if (!isStreamed(buffer)) {
+    return hashWords(hash, bytes, length);
+  }
+  for (size_t offset = 0; offset < length; offset += STREAM_CHUNK) {
+    size_t chunk = length - offset < STREAM_CHUNK ? length - offset : STREAM_CHUNK;
+    hash = hashWords(hash, bytes + offset, chunk);
+    releasePages(bytes + offset, chunk);
+  }
+  return hash;
+}
+
+static uint64_t hashLeaves(uint64_t hash, Rope *rope) {
+  const char *bytes = ropeFlatBytes(rope);
+  if (bytes != NULL) {
+    return hashLeaf(hash, rope->buffer, bytes, rope->length);
+  }
+  return hashLeaves(hashLeaves(hash, rope->left), rope->right);
+}
+
+// Shared buffers are hashed by every interpreter using them
+static uint64_t bufferHash(Buffer *buffer) {
+#ifdef HAVE_THREADS
+  return __atomic_load_n(&buffer->hash, __ATOMIC_RELAXED);
+#else
+  return buffer->hash;
+#endif
+}
+
+static void setBufferHash(Buffer *buffer, uint64_t hash) {
+#ifdef HAVE_THREADS
+  __atomic_store_n(&buffer->hash, hash, __ATOMIC_RELAXED);
+#else
+  buffer->hash = hash;
+#endif
+}
+
+// Content hash of a text, kept in its buffer when the text is the whole
+// buffer. Others are hashed leaf by leaf, so equal texts cut into different
+// leaves may hash differently, which only costs a miss
+static uint64_t textHash(Rope *text) {
+  const char *bytes = ropeFlatBytes(text);
+  Buffer *buffer = text->buffer;
+  if (bytes == NULL || buffer == NULL || bytes != buffer->bytes || text->length != buffer->length) {
+    return hashLeaves(14695981039346656037u, text);
+  }
+  uint64_t hash = bufferHash(buffer);
+  if (hash == 0) {
+    hash = hashLeaf(14695981039346656037u, buffer, bytes, text->length) | 1;
+    setBufferHash(buffer, hash);
+  }
+  return hash;
+}
+
+static bool sameFile(FileHash *file, FileHash *other) {
+  return file->device == other->device && file->inode == other->inode && file->size == other->size
+      && file->modified == other->modified && file->changed == other->changed;
+}
+
+static KnownFile* findKnownFile(TJInterpreter *tj, FileHash *file) {
+  for (size_t i = 0; i < tj->knownFilesSize; i++) {
+    if (sameFile(&tj->knownFiles[i].file, file)) {
+      return &tj->knownFiles[i];
+    }
+  }
+  return NULL;
+}
+
+// NULL when the list is full or memory is short
+static KnownFile* addKnownFile(TJInterpreter *tj, FileHash *file) {
+  if (tj->knownFilesSize == tj->knownFilesCapacity) {
+    if (tj->knownFilesSize >= RESULT_FILES) {
+      return NULL;
+    }
+    size_t capacity = tj->knownFilesCapacity == 0 ? 16 : tj->knownFilesCapacity * 2;
+    KnownFile *files = realloc(tj->knownFiles, capacity * sizeof(KnownFile));
+    if (files == NULL) {
+      return NULL;
+    }
+    tj->knownFiles = files;
+    tj->knownFilesCapacity = capacity;
+  }
+  KnownFile *known = &tj->knownFiles[tj->knownFilesSize++];
+  known->file = *file;
+  known->buffer = NULL;
+  return known;
+}
+
+// Saves the hash textHash just kept in buffer if buffer holds a file
+static void noteFileHash(TJInterpreter *tj, Buffer *buffer) {
+  uint64_t hash = bufferHash(buffer);
+  if (buffer->kind == HEAP_BUFFER || hash == 0) {
+    return;
+  }
+  for (size_t i = 0; i < tj->knownFilesSize; i++) {
+    if (tj->knownFiles[i].buffer == buffer && tj->knownFiles[i].file.hash != hash) {
+      tj->knownFiles[i].file.hash = hash;
+      tj->resultsChanged = true;
+    }
+  }
+}
+
+#ifdef HAVE_MMAP
+// Gives the buffer of a file just read the hash an earlier run saved for
+// that version of the file
+static void recallFileHash(TJInterpreter *tj, Buffer *buffer, struct stat *info) {
+#ifdef __linux__
+  uint64_t modified = (uint64_t) info->st_mtim.tv_sec * 1000000000u + (uint64_t) info->st_mtim.tv_nsec;
+  uint64_t changed = (uint64_t) info->st_ctim.tv_sec * 1000000000u + (uint64_t) info->st_ctim.tv_nsec;
+#else
+  uint64_t modified = (uint64_t) info->st_mtime;
+  uint64_t changed = (uint64_t) info->st_ctime;
+#endif
+  FileHash file = {info->st_dev, info->st_ino, (uint64_t) info->st_size, modified, changed, 0};
+  KnownFile *known = findKnownFile(tj, &file);
+  if (known == NULL && (known = addKnownFile(tj, &file)) == NULL) {
+    return;
+  }
+  known->buffer = buffer;
+  if (known->file.hash != 0 && bufferHash(buffer) == 0) {
+    setBufferHash(buffer, known->file.hash);
+  }
+  noteFileHash(tj, buffer);
+}
+#endif
+
+// Fills query with what identifies a search; false when it is not worth
+// caching
+static bool searchKey(TJInterpreter *tj, Rope *text, Rope *needle, size_t start, CachedResult *query) {
+  if (tj->options.results == NULL || text->length < RESULT_MIN_BYTES || needle->length > RESULT_NEEDLE) {
+    return false;
+  }
+  if (text->length < STREAM_THRESHOLD) {
+    ropeBytes(tj, text); // The search flattens it anyway; the hash then stays in the buffer
+  }
+  Buffer *buffer = text->buffer;
+  bool hashed = buffer == NULL || bufferHash(buffer) != 0;
+  uint64_t hash = textHash(text);
+  if (!hashed) {
+    noteFileHash(tj, buffer);
+  }
+  memset(query, 0, sizeof(CachedResult));
+  memcpy(query->needle, ropeBytes(tj, needle), needle->length);
+  query->textLength = text->length;
+  query->start = start;
+  query->needleLength = needle->length;
+  uint64_t parts[4] = {hash, text->length, needle->length, start};
+  uint64_t key = hashWords(hashWords(14695981039346656037u, (const char*) parts, sizeof(parts)),
+                           query->needle, needle->length);
+  query->key = key == 0 ? 1 : key;
+  return true;
+}
+
+static bool sameSearch(CachedResult *result, CachedResult *query) {
+  return result->key == query->key && result->textLength == query->textLength && result->start == query->start
+      && result->needleLength == query->needleLength
+      && memcmp(result->needle, query->needle, sizeof(query->needle)) == 0;
+}
+
+// Open addressing with linear probing, at most 3/4 full; key 0 marks a free
+// slot. False if the entry is already there, the table is full or memory is
+// short, since the cache only ever saves work
+static bool insertResult(TJInterpreter *tj, CachedResult *entry) {
+  if ((tj->resultsSize + 1) * 4 > tj->resultsCapacity * 3) {
+    if (tj->resultsSize >= RESULT_ENTRIES) {
+      return false;
+    }
+    size_t capacity = tj->resultsCapacity == 0 ? 1024 : tj->resultsCapacity * 2;
+    CachedResult *results = calloc(capacity, sizeof(CachedResult));
+    if (results == NULL) {
+      return false;
+    }
+    for (size_t i = 0; i < tj->resultsCapacity; i++) {
+      if (tj->results[i].key != 0) {
+        size_t slot = tj->results[i].key & (capacity - 1);
+        while (results[slot].key != 0) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        results[slot] = tj->results[i];
+      }
+    }
+    free(tj->results);
+    tj->results = results;
+    tj->resultsCapacity = capacity;
+  }
+  size_t slot = entry->key & (tj->resultsCapacity - 1);
+  while (tj->results[slot].key != 0) {
+    if (sameSearch(&tj->results[slot], entry)) {
+      return false;
+    }
+    slot = (slot + 1) & (tj->resultsCapacity - 1);
+  }
+  tj->results[slot] = *entry;
+  tj->resultsSize++;
+  return true;
+}
+
+static bool findResult(TJInterpreter *tj, CachedResult *query, size_t *found) {
+  if (tj->resultsCapacity > 0) {
+    size_t slot = query->key & (tj->resultsCapacity - 1);
+    while (tj->results[slot].key != 0) {
+      if (sameSearch(&tj->results[slot], query)) {
+        *found = tj->results[slot].found == UINT64_MAX ? NOT_FOUND : (size_t) tj->results[slot].found;
+        tj->resultHits++;
+        return true;
+      }
+      slot = (slot + 1) & (tj->resultsCapacity - 1);
+    }
+  }
+  tj->resultMisses++;
+  return false;
+}
+
+static void addResult(TJInterpreter *tj, CachedResult *query, size_t found) {
+  query->found = found == NOT_FOUND ? UINT64_MAX : (uint64_t) found;
+  if (insertResult(tj, query)) {
+    tj->resultsChanged = true;
+  }
+}
+
+static char* resultsPath(TJInterpreter *tj) {
+  const char *directory = tj->options.results;
+  char *path = malloc(strlen(directory) + 13);
+  if (path != NULL) {
+    sprintf(path, "%s/results.tjr", directory);
+  }
+  return path;
+}
+
+// Adds the entries and file hashes saved at path; a missing or damaged file
+// adds nothing
+static void readResults(TJInterpreter *tj, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return;
+  }
+  ResultsHeader header;
+  if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == RESULTS_MAGIC
+      && header.version == RESULTS_VERSION && header.count <= RESULT_ENTRIES && header.files <= RESULT_FILES) {
+    size_t bytes = (size_t) header.count * sizeof(CachedResult);
+    size_t fileBytes = (size_t) header.files * sizeof(FileHash);
+    CachedResult *entries = malloc(bytes + 1);
+    FileHash *files = malloc(fileBytes + 1);
+    if (entries != NULL && files != NULL && fread(entries, 1, bytes, file) == bytes
+        && fread(files, 1, fileBytes, file) == fileBytes
+        && hashWords(hashWords(14695981039346656037u, (const char*) entries, bytes), (const char*) files, fileBytes)
+           == header.checksum) {
+      for (uint64_t i = 0; i < header.count; i++) {
+        if (entries[i].key != 0 && entries[i].needleLength <= RESULT_NEEDLE) {
+          insertResult(tj, &entries[i]);
+        }
+      }
+      for (uint64_t i = 0; i < header.files; i++) {
+        KnownFile *known = findKnownFile(tj, &files[i]);
+        if (known == NULL) {
+          addKnownFile(tj, &files[i]);
+        } else if (known->file.hash == 0) {
+          known->file.hash = files[i].hash;
+        }
+      }
+    }
+    free(entries);
+    free(files);
+  }
+  fclose(file);
+}
+
+static void loadResults(TJInterpreter *tj) {
+  char *path = resultsPath(tj);
+  if (path != NULL) {
+    readResults(tj, path);
+  }
+  free(path);
+  tj->resultsLoaded = true;
+}
+
+// Never raises: it also runs while a failed run unwinds
+static void saveResults(TJInterpreter *tj) {
+  char *path = resultsPath(tj);
+  char *temporary = path != NULL ? malloc(strlen(path) + 48) : NULL;
+  if (temporary == NULL) {
+    free(path);
+    return;
+  }
+#ifdef HAVE_MMAP
+  mkdir(tj->options.results, 0777);
+  sprintf(temporary, "%s.%ld.%lx.tmp", path, (long) getpid(), (unsigned long) (uintptr_t) tj);
+#else
+  sprintf(temporary, "%s.%lx.tmp", path, (unsigned long) (uintptr_t) tj);
+#endif
+  readResults(tj, path);
+  CachedResult *entries = malloc(tj->resultsSize * sizeof(CachedResult) + 1);
+  FileHash *files = malloc(tj->knownFilesSize * sizeof(FileHash) + 1);
+  FILE *file = entries != NULL && files != NULL ? fopen(temporary, "wb") : NULL;
+  if (file != NULL) {
+    size_t count = 0;
+    for (size_t i = 0; i < tj->resultsCapacity; i++) {
+      if (tj->results[i].key != 0) {
+        entries[count++] = tj->results[i];
+      }
+    }
+    size_t fileCount = 0;
+    for (size_t i = 0; i < tj->knownFilesSize; i++) {
+      if (tj->knownFiles[i].file.hash != 0) {
+        files[fileCount++] = tj->knownFiles[i].file;
+      }
+    }
+    uint64_t checksum = hashWords(hashWords(14695981039346656037u, (const char*) entries, count * sizeof(CachedResult)),
+                                  (const char*) files, fileCount * sizeof(FileHash));
+    ResultsHeader header = {RESULTS_MAGIC, RESULTS_VERSION, count, fileCount, checksum};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+                && fwrite(entries, sizeof(CachedResult), count, file) == count
+                && fwrite(files, sizeof(FileHash), fileCount, file) == fileCount;
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+      remove(temporary);
+    }
+  }
+  tj->resultsChanged = false;
+  free(entries);
+  free(files);
+  free(temporary);
+  free(path);
+}
+
+// locate at run time, where the same text is often searched again
+static int64_t locateText(TJInterpreter *tj, Rope *text, Rope *needle, int64_t start) {
+  const char *needleBytes = ropeBytes(tj, needle);
+  if (start < 0 || (uint64_t) start >= text->length) {
+    return 0;
+  }
+  size_t found;
+  CachedResult query;
+  bool cached = searchKey(tj, text, needle, (size_t) start, &query);
+  if (cached && findResult(tj, &query, &found)) {
+    return found == NOT_FOUND ? 0 : (int64_t) found;
+  }
+  if (text->length >= STREAM_THRESHOLD) {
+    found = searchRope(tj, text, needleBytes, needle->length, (size_t) start);
+  } else {
+    const char *bytes = ropeBytes(tj, text);
+    if (!searchIndexed(tj, text, needleBytes, needle->length, (size_t) start, &found)) {
+      found = searchLarge(tj, text->buffer, bytes, text->length, needleBytes, needle->length, (size_t) start);
+      countScan(tj, text, (found == NOT_FOUND ? text->length : found) - (size_t) start);
+    }
+  }
+  if (cached) {
+    addResult(tj, &query, found);
+  }
+  return found == NOT_FOUND ? 0 : (int64_t) found;
+}
+
+static Rope* insertFunc(TJInterpreter *tj, Rope* myText, int64_t location, Rope* insertText) {
+  if (location < 0 || (uint64_t) location > myText->length) { return retainRope(tj, myText); }
+  Rope *left, *right;
+  ropeSplit(tj, retainRope(tj, myText), location, &left, &right);
+  return ropeConcat(tj, ropeConcat(tj, left, retainRope(tj, insertText)), right);
+}
+
+// Keeps the first location bytes followed by as much of ovrText as fits in
+// the original length
+static Rope* overrideFunc(TJInterpreter *tj, Rope* myText, int64_t location, Rope* ovrText) {
+  int64_t textLen = (int64_t) myText->length;
+  if (location < 0 || location > textLen) { return retainRope(tj, myText); }
+  int64_t newLen = location + (int64_t) ovrText->length;
+  if (newLen > textLen) { newLen = textLen; }
+  Rope *prefix = ropeSlice(tj, retainRope(tj, myText), 0, location);
+  return ropeConcat(tj, prefix, ropeSlice(tj, retainRope(tj, ovrText), 0, newLen - location));
+}
+
+// Concatenates the texts in count slots. Each run of short texts is copied
+// into one new leaf sized up front; long texts are shared as rope nodes
+static Rope* joinFunc(TJInterpreter *tj, const int *slots, int count) {
+  Rope *result = &emptyRope;
+  int i = 0;
+  while (i < count) {
+    size_t length = 0;
+    int end = i;
+    while (end < count && tj->variables[slots[end]].value.text->length < ROPE_LEAF_SIZE) {
+      length += tj->variables[slots[end++]].value.text->length;
+    }
+    if (end - i < 2) {
+      result = ropeConcat(tj, result, retainRope(tj, tj->variables[slots[i++]].value.text));
+      continue;
+    }
+    Buffer *buffer = newBuffer(tj, length);
+    char *next = buffer->bytes;
+    for (; i < end; i++) {
+      Rope *text = tj->variables[slots[i]].value.text;
+      ropeCopy(text, next);
+      next += text->length;
+    }
+    result = ropeConcat(tj, result, ropeLeaf(tj, buffer, buffer->bytes, length));
+  }
+  return result;
+}
+
+typedef struct {
+  char *name;
+  OpCode op;
+  int argCount;
+  TokenType argTokens[3];
+  DataType argTypes[3];
+  DataType resultType;
+} Builtin;
+
+static const Builtin BUILTINS[] = {
+  {"size", OP_SIZE, 1, {IDENTIFIER}, {TEXT}, INT},
+  {"subs", OP_SUBS, 3, {IDENTIFIER, INT_CONST, INT_CONST}, {TEXT, INT, INT}, TEXT},
+  {"locate", OP_LOCATE, 3, {IDENTIFIER, IDENTIFIER, INT_CONST}, {TEXT, TEXT, INT}, INT},
+  {"asString", OP_AS_STRING, 1, {IDENTIFIER}, {INT}, TEXT},
+  {"asText", OP_AS_TEXT, 1, {IDENTIFIER}, {TEXT}, INT},
+  {"insert", OP_INSERT, 3, {IDENTIFIER, INT_CONST, IDENTIFIER}, {TEXT, INT, TEXT}, TEXT},
+  {"override", OP_OVERRIDE, 3, {IDENTIFIER, INT_CONST, IDENTIFIER}, {TEXT, INT, TEXT}, TEXT}
+};
+
+// Parses a call starting at line[*position], leaves *position after its
+// closing parenthesis and returns the builtin with its operands
+static const Builtin* parseCall(TJInterpreter *tj, Token *line, int *position, int operands[3]) {
+  const Builtin *builtin = NULL;
+  for (size_t i = 0; i < sizeof(BUILTINS) / sizeof(BUILTINS[0]); i++) {
+    if (strcmp(BUILTINS[i].name, line[*position].lexeme) == 0) {
+      builtin = &BUILTINS[i];
+    }
+  }
+  if (builtin == NULL) {
+    raiseError(tj, "Invalid function assignment!");
+  }
+  Token *args = &line[*position + 2];
+  for (int i = 0; i < builtin->argCount; i++) {
+    Token arg = args[2 * i];
+    TokenType separator = i == builtin->argCount - 1 ? PARENTHESIS_CLOSE : COMMA;
+    // Positions may also be int variables, so loops can move through a text
+    bool positionArgument = builtin->argTokens[i] == INT_CONST && arg.type == IDENTIFIER;
+    if ((arg.type != builtin->argTokens[i] && !positionArgument) || args[2 * i + 1].type != separator) {
+      raiseError(tj, "Invalid function assignment!");
+    }
+    if (arg.type == INT_CONST) {
+      operands[i] = addIntConstant(tj, arg.lexeme);
+    } else {
+      operands[i] = getTypedVariable(tj, arg.lexeme, builtin->argTypes[i], "Invalid function assignment!");
+    }
+  }
+  *position += 2 + 2 * builtin->argCount;
+  return builtin;
+}
+
+static void parseFunctionAssignment(TJInterpreter *tj, Token *line) {
+  int operands[3] = {0, 0, 0};
+  int position = 2;
+  const Builtin *builtin = parseCall(tj, line, &position, operands);
+  if (line[position].type != NO_TYPE) {
+    raiseError(tj, "Invalid function assignment!");
+  }
+  int variable = getTypedVariable(tj, line[0].lexeme, builtin->resultType, "Invalid function assignment!");
+  emit(tj, builtin->op, variable, operands[0], operands[1], operands[2]);
+}
+
+static int parseOperand(TJInterpreter *tj, Token token, DataType type) {
+  if (token.type == IDENTIFIER) {
+    return getTypedVariable(tj, token.lexeme, type, "Invalid arithmetic assignment!");
+  }
+  if (type == INT && token.type == INT_CONST) {
+    return addIntConstant(tj, token.lexeme);
+  }
+  if (type == TEXT && token.type == STR_CONST) {
+    return addTextConstant(tj, token.lexeme, token.length);
+  }
+  raiseError(tj, "Invalid arithmetic assignment!");
+}
+
+// An operand of an expression: a variable, a constant or a builtin call,
+// whose result goes to the next free temporary
+static int parseTerm(TJInterpreter *tj, Token *line, int *position, DataType type, int *calls) {
+  Token token = line[*position];
+  if (token.type != KEYWORD || line[*position + 1].type != PARENTHESIS_OPEN) {
+    (*position)++;
+    return parseOperand(tj, token, type);
+  }
+  int operands[3] = {0, 0, 0};
+  const Builtin *builtin = parseCall(tj, line, position, operands);
+  if (builtin->resultType != type) {
+    raiseError(tj, "Invalid arithmetic assignment!");
+  }
+  int result = getTemporary(tj, type, ++*calls);
+  emit(tj, builtin->op, result, operands[0], operands[1], operands[2]);
+  return result;
+}
+
+static bool parseSign(TJInterpreter *tj, Token *line, int *position) {
+  Token token = line[(*position)++];
+  if (token.type != OPERATOR || strcmp(token.lexeme, "=") == 0) {
+    raiseError(tj, "Invalid arithmetic assignment!");
+  }
+  return token.lexeme[0] == '+';
+}
+
+// Joins the pending text operands into destination; a single operand is
+// used as it is
+static int emitConcat(TJInterpreter *tj, int destination, int *parts, int count) {
+  if (count == 1) {
+    return parts[0];
+  }
+  if (count == 2) {
+    emit(tj, OP_CONCAT, destination, parts[0], parts[1], 0);
+  } else {
+    emit(tj, OP_JOIN, destination, addOperands(tj, parts, count), count, 0);
+  }
+  return destination;
+}
+
+// Evaluates `x := a + b - c ...` left to right. Intermediate results go to a
+// temporary and only the last operation writes the target, so the target
+// may appear among the operands. Consecutive text additions become a
+// single join
+static void parseArithmeticAssignment(TJInterpreter *tj, Token *line) {
+  if (line[0].type != IDENTIFIER) {
+    raiseError(tj, "Invalid arithmetic assignment!");
+  }
+  int variable = getVariable(tj, line[0].lexeme);
+  DataType type = tj->variables[variable].value.type;
+  int accumulator = getTemporary(tj, type, 0);
+  int calls = 0;
+  int position = 2;
+  int result = parseTerm(tj, line, &position, type, &calls);
+  if (type == INT) {
+    while (line[position].type != NO_TYPE) {
+      bool add = parseSign(tj, line, &position);
+      int operand = parseTerm(tj, line, &position, type, &calls);
+      int destination = line[position].type == NO_TYPE ? variable : accumulator;
+      emit(tj, add ? OP_ADD : OP_SUB, destination, result, operand, 0);
+      result = destination;
+    }
+  } else {
+    int length = position;
+    while (line[length].type != NO_TYPE) {
+      length++;
+    }
+    int *parts = arenaAlloc(tj, length * sizeof(int));
+    int count = 0;
+    parts[count++] = result;
+    while (line[position].type != NO_TYPE) {
+      bool add = parseSign(tj, line, &position);
+      int operand = parseTerm(tj, line, &position, type, &calls);
+      if (add) {
+        parts[count++] = operand;
+        continue;
+      }
+      int text = emitConcat(tj, accumulator, parts, count);
+      int destination = line[position].type == NO_TYPE ? variable : accumulator;
+      emit(tj, OP_REMOVE, destination, text, operand, 0);
+      count = 0;
+      parts[count++] = destination;
+    }
+    result = emitConcat(tj, variable, parts, count);
+  }
+  if (result != variable) {
+    emit(tj, OP_MOVE, variable, result, 0, 0);
+  }
+}
+
+// Whether an operator follows the first operand of an assignment
+static bool isExpression(Token *line) {
+  int position = 3;
+  if (line[2].type == KEYWORD && line[3].type == PARENTHESIS_OPEN) {
+    while (line[position].type != NO_TYPE && line[position].type != PARENTHESIS_CLOSE) {
+      position++;
+    }
+    if (line[position].type == NO_TYPE) {
+      return false;
+    }
+    position++;
+  }
+  return line[position].type == OPERATOR;
+}
+
+static void parseLine(TJInterpreter *tj, Token *line) {
+  //DECLARATION
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "new") == 0) {
+    return parseDeclaration(tj, line);
+  }
+  //COMMAND OUTPUT
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "output") == 0) {
+    return parseOutput(tj, line);
+  }
+  //COMMAND INPUT
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "input") == 0) {
+    return parseInput(tj, line);
+  }
+  //COMMAND READ
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "read") == 0) {
+    return parseRead(tj, line);
+  }
+  //COMMAND WRITE
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "write") == 0) {
+    return parseWrite(tj, line);
+  }
+  //LOOP
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "loop") == 0) {
+    return parseLoop(tj, line);
+  }
+  if (line[0].type == KEYWORD && strcmp(line[0].lexeme, "end") == 0) {
+    return parseLoopEnd(tj, line);
+  }
+  //ASSIGNMENT
+  if (line[1].type == OPERATOR && strcmp(line[1].lexeme, "=") == 0) {
+    if(line[3].type == NO_TYPE) {
+      return parseAssignment(tj, line);
+    } else if(line[2].type == KEYWORD && line[3].type == PARENTHESIS_OPEN && !isExpression(line)){
+      return parseFunctionAssignment(tj, line);
+    } else if(isExpression(line)) {
+      return parseArithmeticAssignment(tj, line);
+    } else {
+      raiseError(tj, "Invalid assignment!");
+    }
+  }
+  raiseError(tj, "Parsing error!");
+}
+
+static void compileProgram(TJInterpreter *tj) {
+  Token token;
+  // Parsers look a fixed number of tokens ahead, so the line always keeps
+  // that many zeroed tokens after the last one
+  int capacity = 2 * LINE_LOOKAHEAD;
+  Token* line = arenaAlloc(tj, capacity * sizeof(Token));
+  memset(line, 0, capacity * sizeof(Token));
+  int i = 0;
+  while ((token = getNextToken(tj)).type != ENDOFFILE) {
+    if (token.type != ENDOFLINE) {
+      if (i + LINE_LOOKAHEAD == capacity) {
+        Token *grown = arenaAlloc(tj, 2 * capacity * sizeof(Token));
+        memcpy(grown, line, i * sizeof(Token));
+        memset(grown + i, 0, (2 * capacity - i) * sizeof(Token));
+        line = grown;
+        capacity *= 2;
+      }
+      line[i++] = token;
+    } else {
+      line[i].type = NO_TYPE;
+      parseLine(tj, line);
+      arenaReset(tj);
+      capacity = 2 * LINE_LOOKAHEAD;
+      line = arenaAlloc(tj, capacity * sizeof(Token));
+      memset(line, 0, capacity * sizeof(Token));
+      i = 0;
+      tj->currentLine++;
+    }
+  }
+  emit(tj, OP_HALT, 0, 0, 0, 0);
+  linkLoops(tj);
+}
+
+static Rope* formatInt(TJInterpreter *tj, int64_t number) {
+  char string[21];
+  int length = sprintf(string, "%" PRId64, number);
+  return ropeFromBytes(tj, string, length);
+}
+
+static void ropeCopyPrefix(Rope *rope, char *destination, size_t count) {
+  const char *bytes = ropeFlatBytes(rope);
+  if (bytes != NULL || count <= rope->left->length) {
+    if (bytes != NULL) {
+      memcpy(destination, bytes, count);
+    } else {
+      ropeCopyPrefix(rope->left, destination, count);
+    }
+    return;
+  }
+  ropeCopy(rope->left, destination);
+  ropeCopyPrefix(rope->right, destination + rope->left->length, count - rope->left->length);
+}
+
+static int64_t parseInt(Rope *text) {
+  char buffer[32];
+  size_t length = text->length < sizeof(buffer) - 1 ? text->length : sizeof(buffer) - 1;
+  ropeCopyPrefix(text, buffer, length);
+  buffer[length] = '\0';
+  return strtoll(buffer, NULL, 10);
+}
+
+#ifndef HAVE_MMAP
+static void printValue(FILE *file, Value value) {
+  if (value.type == INT) {
+    fprintf(file, "%" PRId64, value.number);
+  } else {
+    ropeWrite(value.text, file);
+  }
+}
+#endif
+
+static void outputValue(TJInterpreter *tj, Value value) {
+  if (value.type == INT) {
+    char string[21];
+    writeOutput(tj, string, sprintf(string, "%" PRId64, value.number));
+  } else {
+    ropeOutput(tj, value.text);
+  }
+}
+
+// Input and read accept INT targets too, their text is parsed as a number
+static void storeText(TJInterpreter *tj, Value *value, Rope *text) {
+  if (value->type == INT) {
+    value->number = parseInt(text);
+    releaseRope(tj, text);
+  } else {
+    setText(tj, value, text);
+  }
+}
+
+static void executeInput(TJInterpreter *tj, Instruction *instruction) {
+  outputValue(tj, tj->variables[instruction->b].value);
+  writeOutput(tj, ": ", 2);
+  flushOutput(tj, NULL, 0);
+  // Like fgets: at most 99 bytes, up to and without the newline
+  char buffer[100];
+  size_t length = 0;
+  if (tj->options.host.readLine != NULL) {
+    length = tj->options.host.readLine(tj->options.host.context, buffer, sizeof(buffer) - 1);
+  } else {
+    int ch;
+    while (length < sizeof(buffer) - 1 && (ch = getchar()) != EOF && ch != '\n') {
+      buffer[length++] = (char) ch;
+    }
+  }
+  storeText(tj, &tj->variables[instruction->a].value, ropeFromBytes(tj, buffer, length));
+}
+
+#ifdef HAVE_MMAP
+typedef struct {
+  int fd;
+  int count;
+  struct iovec vectors[WRITE_VECTORS];
+} VectorWriter;
+
+static bool flushVectors(VectorWriter *writer) {
+  bool written = writeVectors(writer->fd, writer->vectors, writer->count);
+  writer->count = 0;
+  return written;
+}
+
+static bool collectVectors(Rope *rope, VectorWriter *writer) {
+  if (ropeFlatBytes(rope) != NULL && isStreamed(rope->buffer)) {
+    if (!flushVectors(writer)) {
+      return false;
+    }
+    for (size_t done = 0; done < rope->length; done += STREAM_CHUNK) {
+      size_t length = rope->length - done < STREAM_CHUNK ? rope->length - done : STREAM_CHUNK;
+      if (!writeBytes(writer->fd, rope->bytes + done, length)) {
+        return false;
+      }
+      releasePages(rope->bytes + done, length);
+    }
+    return true;
+  }
+  if (ropeFlatBytes(rope) != NULL) {
+    if (writer->count == WRITE_VECTORS && !flushVectors(writer)) {
+      return false;
+    }
+    writer->vectors[writer->count].iov_base = (void*) rope->bytes;
+    writer->vectors[writer->count].iov_len = rope->length;
+    writer->count++;
+    return true;
+  }
+  return collectVectors(rope->left, writer) && collectVectors(rope->right, writer);
+}
+
+// Returns false on a write error; the caller closes fd either way
+static bool writeRope(int fd, Rope *rope) {
+  VectorWriter writer;
+  writer.fd = fd;
+  writer.count = 0;
+  return collectVectors(rope, &writer) && flushVectors(&writer);
+}
+
+// Files mapped once and shared read-only by every interpreter created with
+// the same TJFileCache. An entry matches one version of a file, so a file
+// changed on disk gets a new entry and ropes viewing the old one stay valid
+typedef struct {
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t modified;
+  Buffer* buffer;
+} SharedFile;
+
+struct TJFileCache {
+  pthread_mutex_t lock;
+  SharedFile* files;
+  size_t filesSize;
+  size_t filesCapacity;
+};
+
+TJFileCache* tjCreateFileCache(void) {
+  TJFileCache *cache = calloc(1, sizeof(TJFileCache));
+  if (cache != NULL && pthread_mutex_init(&cache->lock, NULL) != 0) {
+    free(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void tjDestroyFileCache(TJFileCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < cache->filesCapacity; i++) {
+    Buffer *buffer = cache->files[i].buffer;
+    if (buffer != NULL) {
+      munmap(buffer->bytes, buffer->length);
+      free(buffer);
+    }
+  }
+  free(cache->files);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+static bool isSharedFile(SharedFile *file, struct stat *info) {
+  return file->device == info->st_dev && file->inode == info->st_ino && file->size == info->st_size
+      && file->modified == info->st_mtime;
+}
+
+// Open addressing like the symbol table; returns the matching entry or the
+// empty slot where it belongs
+static SharedFile* findSharedFile(TJFileCache *cache, struct stat *info) {
+  uint64_t hash = ((uint64_t) info->st_dev * 1099511628211u) ^ (uint64_t) info->st_ino;
+  hash = (hash ^ (uint64_t) info->st_size ^ (uint64_t) info->st_mtime) * 1099511628211u;
+  size_t slot = (hash ^ (hash >> 29)) & (cache->filesCapacity - 1);
+  while (cache->files[slot].buffer != NULL && !isSharedFile(&cache->files[slot], info)) {
+    slot = (slot + 1) & (cache->filesCapacity - 1);
+  }
+  return &cache->files[slot];
+}
+
+static bool growSharedFiles(TJFileCache *cache) {
+  size_t oldCapacity = cache->filesCapacity;
+  SharedFile *oldFiles = cache->files;
+  size_t capacity = oldCapacity == 0 ? 64 : oldCapacity * 2;
+  SharedFile *files = calloc(capacity, sizeof(SharedFile));
+  if (files == NULL) {
+    return false;
+  }
+  cache->files = files;
+  cache->filesCapacity = capacity;
+  for (size_t i = 0; i < oldCapacity; i++) {
+    if (oldFiles[i].buffer != NULL) {
+      struct stat info;
+      info.st_dev = oldFiles[i].device;
+      info.st_ino = oldFiles[i].inode;
+      info.st_size = oldFiles[i].size;
+      info.st_mtime = oldFiles[i].modified;
+      *findSharedFile(cache, &info) = oldFiles[i];
+    }
+  }
+  free(oldFiles);
+  return true;
+}
+
+// Maps the file on first use; the lock is held while mapping so two jobs
+// reading the same file never map it twice
+static Rope* readSharedFile(TJInterpreter *tj, int fd, struct stat *info) {
+  TJFileCache *cache = tj->options.files;
+  pthread_mutex_lock(&cache->lock);
+  if ((cache->filesSize + 1) * 4 > cache->filesCapacity * 3 && !growSharedFiles(cache)) {
+    pthread_mutex_unlock(&cache->lock);
+    close(fd);
+    raiseError(tj, "Out of memory!");
+  }
+  SharedFile *file = findSharedFile(cache, info);
+  if (file->buffer == NULL) {
+    Buffer *buffer = malloc(sizeof(Buffer));
+    char *bytes = mmap(NULL, (size_t) info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buffer == NULL || bytes == MAP_FAILED) {
+      pthread_mutex_unlock(&cache->lock);
+      free(buffer);
+      if (bytes != MAP_FAILED) {
+        munmap(bytes, (size_t) info->st_size);
+      }
+      close(fd);
+      raiseError(tj, "Cannot read file!");
+    }
+    buffer->references = 0;
+    buffer->kind = SHARED_BUFFER;
+    buffer->bytes = bytes;
+    buffer->length = (size_t) info->st_size;
+    buffer->scanned = 0;
+    buffer->index = NULL;
+    buffer->hash = 0;
+    if (isStreamed(buffer)) {
+      madvise(bytes, buffer->length, MADV_SEQUENTIAL);
+    }
+    SharedFile shared = {info->st_dev, info->st_ino, info->st_size, info->st_mtime, buffer};
+    *file = shared;
+    cache->filesSize++;
+  }
+  Buffer *buffer = file->buffer;
+  pthread_mutex_unlock(&cache->lock);
+  return ropeLeaf(tj, buffer, buffer->bytes, buffer->length);
+}
+
+static MappedFile* findMappedFile(TJInterpreter *tj, dev_t device, ino_t inode) {
+  for (size_t i = 0; i < tj->mappedFilesSize; i++) {
+    if (tj->mappedFiles[i].device == device && tj->mappedFiles[i].inode == inode) {
+      return &tj->mappedFiles[i];
+    }
+  }
+  return NULL;
+}
+
+// The mapping behind a rope that is still an unmodified, whole file
+static MappedFile* findMappedSource(TJInterpreter *tj, Rope *rope) {
+  for (size_t i = 0; i < tj->mappedFilesSize; i++) {
+    Buffer *buffer = tj->mappedFiles[i].buffer;
+    if (buffer == rope->buffer && buffer->bytes == rope->bytes && buffer->length == rope->length) {
+      return &tj->mappedFiles[i];
+    }
+  }
+  return NULL;
+}
+
+// Takes ownership of bytes, unmapping them if the entry cannot be added
+static Rope* addMappedFile(TJInterpreter *tj, const char *path, char *bytes, struct stat *info) {
+  size_t length = (size_t) info->st_size;
+  if (tj->mappedFilesSize == tj->mappedFilesCapacity) {
+    size_t capacity = tj->mappedFilesCapacity == 0 ? 8 : tj->mappedFilesCapacity * 2;
+    MappedFile *files = realloc(tj->mappedFiles, capacity * sizeof(MappedFile));
+    if (files == NULL) {
+      munmap(bytes, length);
+      raiseError(tj, "Out of memory!");
+    }
+    tj->mappedFiles = files;
+    tj->mappedFilesCapacity = capacity;
+  }
+  Buffer *buffer = malloc(sizeof(Buffer));
+  char *name = malloc(strlen(path) + 1);
+  if (buffer == NULL || name == NULL) {
+    free(buffer);
+    free(name);
+    munmap(bytes, length);
+    raiseError(tj, "Out of memory!");
+  }
+  strcpy(name, path);
+  tj->bytesAllocated += sizeof(Buffer);
+  buffer->references = 0;
+  buffer->kind = MAPPED_BUFFER;
+  buffer->bytes = bytes;
+  buffer->length = length;
+  buffer->scanned = 0;
+  buffer->index = NULL;
+  buffer->hash = 0;
+  if (isStreamed(buffer)) {
+    madvise(bytes, length, MADV_SEQUENTIAL);
+  }
+  MappedFile mapped = {name, info->st_dev, info->st_ino, buffer};
+  tj->mappedFiles[tj->mappedFilesSize++] = mapped;
+  return ropeLeaf(tj, buffer, bytes, length);
+}
+
+// Closes fd; the mapping stays valid without it
+static Rope* mapFile(TJInterpreter *tj, const char *path, int fd, struct stat *info) {
+  char *bytes = mmap(NULL, (size_t) info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    raiseError(tj, "Cannot read file!");
+  }
+  return addMappedFile(tj, path, bytes, info);
+}
+
+// Pipes and other files without a size are read until end of file; closes fd
+static Rope* readStream(TJInterpreter *tj, int fd) {
+  size_t length = 0;
+  Buffer *buffer = tryNewBuffer(tj, 65536);
+  const char *error = buffer == NULL ? "Out of memory!" : NULL;
+  while (error == NULL) {
+    ssize_t count = read(fd, buffer->bytes + length, buffer->length - length);
+    if (count < 0) {
+      error = "Cannot read file!";
+      break;
+    }
+    if (count == 0) {
+      break;
+    }
+    length += count;
+    if (length == buffer->length) {
+      Buffer *grown = tryNewBuffer(tj, buffer->length * 2);
+      if (grown == NULL) {
+        error = "Out of memory!";
+        break;
+      }
+      memcpy(grown->bytes, buffer->bytes, length);
+      free(buffer);
+      buffer = grown;
+    }
+  }
+  close(fd);
+  if (error != NULL) {
+    free(buffer);
+    raiseError(tj, error);
+  }
+  buffer->bytes[length] = '\0';
+  buffer->length = length;
+  return ropeLeaf(tj, buffer, buffer->bytes, length);
+}
+
+// Copies an unmodified mapped file in the kernel; returns how many bytes
+// were copied, which may stop short of the whole file
+static size_t copyMappedFile(MappedFile *original, int fd) {
+#ifdef __linux__
+  int sourceFd = open(original->path, O_RDONLY);
+  if (sourceFd < 0) {
+    return 0;
+  }
+  struct stat info;
+  if (fstat(sourceFd, &info) != 0 || info.st_dev != original->device || info.st_ino != original->inode) {
+    close(sourceFd);
+    return 0;
+  }
+  loff_t offset = 0;
+  size_t length = original->buffer->length;
+  while ((size_t) offset < length) {
+    ssize_t copied = copy_file_range(sourceFd, &offset, fd, NULL, length - offset, 0);
+    if (copied <= 0) {
+      break;
+    }
+  }
+  close(sourceFd);
+  return (size_t) offset;
+#else
+  return 0;
+#endif
+}
+
+#ifdef HAVE_THREADS
+//ASYNC I/O
+
+typedef enum {
+  PREFETCH_WAITING,
+  PREFETCH_LOADING,
+  PREFETCH_READY,
+  PREFETCH_CLAIMED
+} PrefetchState;
+
+// A file named by an upcoming read statement, mapped ahead by the I/O
+// thread. The read takes the mapping only if the file is still the version
+// that was mapped
+typedef struct {
+  const char* path;
+  int firstRead;
+  PrefetchState state;
+  struct stat info;
+  char* bytes;
+} Prefetch;
+
+// A write statement left to the I/O thread. The vectors point into text,
+// which stays retained until the running thread reaps the finished write.
+// Streamed leaves are split into STREAM_CHUNK vectors marked in streamed,
+// whose pages are released once written
+typedef struct {
+  const char* path;
+  char* target;
+  Rope* text;
+  struct iovec* vectors;
+  bool* streamed;
+  int vectorsSize;
+  int vectorsCapacity;
+  MappedFile original;
+  bool copy;
+  int line;
+  const char* error;
+} PendingWrite;
+
+// One I/O thread per run. Writes go first and finish in the order they were
+// submitted; prefetching stays at most PREFETCH_AHEAD reads ahead of the
+// program. Counters and prefetch states are guarded by lock
+struct AsyncIO {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  bool stopping;
+  Prefetch* prefetches;
+  int prefetchesSize;
+  int readsStarted;
+  PendingWrite writes[WRITE_SLOTS];
+  long writesSubmitted;
+  long writesCompleted;
+  long writesReaped;
+};
+
+static void loadPrefetch(Prefetch *prefetch) {
+  int fd = open(prefetch->path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  if (fstat(fd, &prefetch->info) == 0 && S_ISREG(prefetch->info.st_mode) && prefetch->info.st_size > 0) {
+    // Streamed files only get their first chunk read ahead
+    size_t length = (size_t) prefetch->info.st_size;
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (length < STREAM_THRESHOLD) {
+      flags |= MAP_POPULATE;
+    }
+#endif
+    char *bytes = mmap(NULL, length, PROT_READ, flags, fd, 0);
+    if (bytes != MAP_FAILED && flags == MAP_PRIVATE) {
+      madvise(bytes, length < STREAM_THRESHOLD ? length : STREAM_CHUNK, MADV_WILLNEED);
+    }
+    prefetch->bytes = bytes != MAP_FAILED ? bytes : NULL;
+  }
+  close(fd);
+}
+
+static bool writeGathered(int fd, PendingWrite *write) {
+  int first = 0;
+  for (int i = 0; i < write->vectorsSize; i++) {
+    if (write->streamed[i]) {
+      const char *bytes = write->vectors[i].iov_base;
+      size_t length = write->vectors[i].iov_len;
+      if (!writeVectors(fd, write->vectors + first, i - first) || !writeBytes(fd, bytes, length)) {
+        return false;
+      }
+      releasePages(bytes, length);
+      first = i + 1;
+    }
+  }
+  return writeVectors(fd, write->vectors + first, write->vectorsSize - first);
+}
+
+static void performWrite(PendingWrite *write) {
+  int fd = open(write->target != NULL ? write->target : write->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    write->error = "File not found!";
+    return;
+  }
+  size_t copied = write->copy ? copyMappedFile(&write->original, fd) : 0;
+  bool written = copied > 0
+               ? writeBytes(fd, write->original.buffer->bytes + copied, write->original.buffer->length - copied)
+               : writeGathered(fd, write);
+  close(fd);
+  if (!written || (write->target != NULL && rename(write->target, write->path) != 0)) {
+    write->error = "Cannot write file!";
+  }
+}
+
+static void* runAsyncIO(void *argument) {
+  AsyncIO *io = argument;
+  int next = 0;
+  pthread_mutex_lock(&io->lock);
+  for (;;) {
+    if (io->writesCompleted < io->writesSubmitted) {
+      PendingWrite *write = &io->writes[io->writesCompleted % WRITE_SLOTS];
+      pthread_mutex_unlock(&io->lock);
+      performWrite(write);
+      pthread_mutex_lock(&io->lock);
+      io->writesCompleted++;
+      pthread_cond_broadcast(&io->done);
+      continue;
+    }
+    if (io->stopping) {
+      break;
+    }
+    while (next < io->prefetchesSize && io->prefetches[next].state != PREFETCH_WAITING) {
+      next++;
+    }
+    if (next < io->prefetchesSize && io->prefetches[next].firstRead < io->readsStarted + PREFETCH_AHEAD) {
+      Prefetch *prefetch = &io->prefetches[next];
+      prefetch->state = PREFETCH_LOADING;
+      pthread_mutex_unlock(&io->lock);
+      loadPrefetch(prefetch);
+      pthread_mutex_lock(&io->lock);
+      prefetch->state = PREFETCH_READY;
+      pthread_cond_broadcast(&io->done);
+      continue;
+    }
+    pthread_cond_wait(&io->wake, &io->lock);
+  }
+  pthread_mutex_unlock(&io->lock);
+  return NULL;
+}
+
+// Collects the prefetch list and starts the I/O thread; without a thread
+// the run simply does its I/O itself. A file the program writes before
+// reading it is not prefetched, its first version would only be thrown away
+static void startAsyncIO(TJInterpreter *tj) {
+  AsyncIO *io = calloc(1, sizeof(AsyncIO));
+  const char **written = malloc((tj->program.size + 1) * sizeof(char*));
+  if (io == NULL || written == NULL) {
+    free(io);
+    free(written);
+    raiseError(tj, "Out of memory!");
+  }
+  io->prefetches = malloc((tj->program.size + 1) * sizeof(Prefetch));
+  int writtenSize = 0;
+  int reads = 0;
+  for (size_t i = 0; i < tj->program.size && io->prefetches != NULL && tj->options.files == NULL; i++) {
+    Instruction *instruction = &tj->program.code[i];
+    if (instruction->op != OP_READ && instruction->op != OP_WRITE) {
+      continue;
+    }
+    const char *path = ropeBytes(tj, tj->variables[instruction->b].value.text);
+    if (instruction->op == OP_WRITE) {
+      written[writtenSize++] = path;
+      continue;
+    }
+    bool skip = false;
+    for (int j = 0; j < writtenSize && !skip; j++) {
+      skip = strcmp(written[j], path) == 0;
+    }
+    for (int j = 0; j < io->prefetchesSize && !skip; j++) {
+      skip = strcmp(io->prefetches[j].path, path) == 0;
+    }
+    if (!skip) {
+      Prefetch prefetch = {.path = path, .firstRead = reads, .state = PREFETCH_WAITING};
+      io->prefetches[io->prefetchesSize++] = prefetch;
+    }
+    reads++;
+  }
+  free(written);
+  pthread_mutex_init(&io->lock, NULL);
+  pthread_cond_init(&io->wake, NULL);
+  pthread_cond_init(&io->done, NULL);
+  if (io->prefetches == NULL || pthread_create(&io->thread, NULL, runAsyncIO, io) != 0) {
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->wake);
+    pthread_cond_destroy(&io->done);
+    free(io->prefetches);
+    free(io);
+    return;
+  }
+  tj->io = io;
+}
+
+// Releases finished writes. With raise, the first one that failed stops the
+// program at its write statement
+static void reapWrites(TJInterpreter *tj, bool raise) {
+  AsyncIO *io = tj->io;
+  pthread_mutex_lock(&io->lock);
+  long completed = io->writesCompleted;
+  pthread_mutex_unlock(&io->lock);
+  const char *error = NULL;
+  int line = 0;
+  for (; io->writesReaped < completed; io->writesReaped++) {
+    PendingWrite *write = &io->writes[io->writesReaped % WRITE_SLOTS];
+    if (write->error != NULL && error == NULL) {
+      error = write->error;
+      line = write->line;
+    }
+    releaseRope(tj, write->text);
+    free(write->target);
+  }
+  if (error != NULL && raise) {
+    tj->currentLine = line;
+    raiseError(tj, error);
+  }
+}
+
+// The barrier before a read of a file with a pending write and at the end
+// of the run
+static void flushWrites(TJInterpreter *tj) {
+  AsyncIO *io = tj->io;
+  pthread_mutex_lock(&io->lock);
+  while (io->writesCompleted < io->writesSubmitted) {
+    pthread_cond_wait(&io->done, &io->lock);
+  }
+  pthread_mutex_unlock(&io->lock);
+  reapWrites(tj, true);
+}
+
+// Finishes pending writes, whether or not the run failed, and unmaps
+// prefetched files no read has taken
+static void stopAsyncIO(TJInterpreter *tj) {
+  AsyncIO *io = tj->io;
+  if (io == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&io->lock);
+  io->stopping = true;
+  pthread_cond_signal(&io->wake);
+  pthread_mutex_unlock(&io->lock);
+  pthread_join(io->thread, NULL);
+  reapWrites(tj, false);
+  for (int i = 0; i < WRITE_SLOTS; i++) {
+    free(io->writes[i].vectors);
+    free(io->writes[i].streamed);
+  }
+  for (int i = 0; i < io->prefetchesSize; i++) {
+    if (io->prefetches[i].bytes != NULL) {
+      munmap(io->prefetches[i].bytes, (size_t) io->prefetches[i].info.st_size);
+    }
+  }
+  pthread_mutex_destroy(&io->lock);
+  pthread_cond_destroy(&io->wake);
+  pthread_cond_destroy(&io->done);
+  free(io->prefetches);
+  free(io);
+  tj->io = NULL;
+}
+
+// Called by every read: waits for pending writes to the same file and lets
+// prefetching move on
+static void startRead(TJInterpreter *tj, const char *path) {
+  AsyncIO *io = tj->io;
+  for (long i = io->writesReaped; i < io->writesSubmitted; i++) {
+    if (strcmp(io->writes[i % WRITE_SLOTS].path, path) == 0) {
+      flushWrites(tj);
+      break;
+    }
+  }
+  pthread_mutex_lock(&io->lock);
+  io->readsStarted++;
+  pthread_cond_signal(&io->wake);
+  pthread_mutex_unlock(&io->lock);
+}
+
+// The prefetched mapping of path if it matches the opened file, else NULL.
+// Either way the entry is done; one still loading is waited for
+static char* claimPrefetch(TJInterpreter *tj, const char *path, struct stat *info) {
+  AsyncIO *io = tj->io;
+  Prefetch *prefetch = NULL;
+  for (int i = 0; i < io->prefetchesSize && prefetch == NULL; i++) {
+    if (strcmp(io->prefetches[i].path, path) == 0) {
+      prefetch = &io->prefetches[i];
+    }
+  }
+  if (prefetch == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&io->lock);
+  while (prefetch->state == PREFETCH_LOADING) {
+    pthread_cond_wait(&io->done, &io->lock);
+  }
+  prefetch->state = PREFETCH_CLAIMED;
+  pthread_mutex_unlock(&io->lock);
+  char *bytes = prefetch->bytes;
+  prefetch->bytes = NULL;
+  if (bytes != NULL && (prefetch->info.st_dev != info->st_dev || prefetch->info.st_ino != info->st_ino
+      || prefetch->info.st_size != info->st_size || prefetch->info.st_mtime != info->st_mtime)) {
+    munmap(bytes, (size_t) prefetch->info.st_size);
+    bytes = NULL;
+  }
+  return bytes;
+}
+
+// Waits for a free slot, raising the error of a failed earlier write first
+static PendingWrite* reserveWrite(TJInterpreter *tj) {
+  AsyncIO *io = tj->io;
+  reapWrites(tj, true);
+  while (io->writesSubmitted - io->writesReaped == WRITE_SLOTS) {
+    pthread_mutex_lock(&io->lock);
+    while (io->writesCompleted == io->writesReaped) {
+      pthread_cond_wait(&io->done, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+    reapWrites(tj, true);
+  }
+  PendingWrite *write = &io->writes[io->writesSubmitted % WRITE_SLOTS];
+  write->vectorsSize = 0;
+  write->error = NULL;
+  return write;
+}
+
+static void addGathered(TJInterpreter *tj, PendingWrite *write, const char *bytes, size_t length, bool streamed) {
+  if (write->vectorsSize == write->vectorsCapacity) {
+    int capacity = write->vectorsCapacity == 0 ? WRITE_VECTORS : write->vectorsCapacity * 2;
+    struct iovec *vectors = realloc(write->vectors, capacity * sizeof(struct iovec));
+    if (vectors != NULL) {
+      write->vectors = vectors;
+    }
+    bool *flags = realloc(write->streamed, capacity * sizeof(bool));
+    if (flags != NULL) {
+      write->streamed = flags;
+    }
+    if (vectors == NULL || flags == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+    write->vectorsCapacity = capacity;
+  }
+  write->vectors[write->vectorsSize].iov_base = (void*) bytes;
+  write->vectors[write->vectorsSize].iov_len = length;
+  write->streamed[write->vectorsSize] = streamed;
+  write->vectorsSize++;
+}
+
+static void gatherVectors(TJInterpreter *tj, Rope *rope, PendingWrite *write) {
+  if (ropeFlatBytes(rope) != NULL && isStreamed(rope->buffer)) {
+    for (size_t done = 0; done < rope->length; done += STREAM_CHUNK) {
+      size_t length = rope->length - done < STREAM_CHUNK ? rope->length - done : STREAM_CHUNK;
+      addGathered(tj, write, rope->bytes + done, length, true);
+    }
+    return;
+  }
+  if (ropeFlatBytes(rope) != NULL) {
+    addGathered(tj, write, rope->bytes, rope->length, false);
+    return;
+  }
+  gatherVectors(tj, rope->left, write);
+  gatherVectors(tj, rope->right, write);
+}
+
+// Takes over text and target, whose vectors are already gathered; the file
+// is written by the I/O thread
+static void submitWrite(TJInterpreter *tj, PendingWrite *write, const char *path, char *target, Rope *text) {
+  AsyncIO *io = tj->io;
+  MappedFile *original = findMappedSource(tj, text);
+  write->path = path;
+  write->target = target;
+  write->text = text;
+  write->copy = original != NULL;
+  if (original != NULL) {
+    write->original = *original;
+  }
+  write->line = tj->currentLine;
+  pthread_mutex_lock(&io->lock);
+  io->writesSubmitted++;
+  pthread_cond_signal(&io->wake);
+  pthread_mutex_unlock(&io->lock);
+}
+#endif
+
+static void executeRead(TJInterpreter *tj, Instruction *instruction) {
+  const char *path = ropeBytes(tj, tj->variables[instruction->b].value.text);
+#ifdef HAVE_THREADS
+  if (tj->io != NULL) {
+    startRead(tj, path);
+  }
+#endif
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    raiseError(tj, "File not found!");
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    raiseError(tj, "Cannot read file!");
+  }
+  // Each branch closes fd before anything in it can raise
+  Rope *text;
+  if (!S_ISREG(info.st_mode)) {
+    text = readStream(tj, fd);
+  } else if (info.st_size == 0) {
+    close(fd);
+    text = &emptyRope;
+  } else if (tj->options.files != NULL) {
+    text = readSharedFile(tj, fd, &info);
+    close(fd);
+  } else {
+    MappedFile *mapped = findMappedFile(tj, info.st_dev, info.st_ino);
+    if (mapped != NULL && mapped->buffer->length == (size_t) info.st_size) {
+      close(fd);
+      text = ropeLeaf(tj, mapped->buffer, mapped->buffer->bytes, mapped->buffer->length);
+    } else {
+#ifdef HAVE_THREADS
+      char *bytes = tj->io != NULL ? claimPrefetch(tj, path, &info) : NULL;
+      if (bytes != NULL) {
+        close(fd);
+        text = addMappedFile(tj, path, bytes, &info);
+      } else {
+        text = mapFile(tj, path, fd, &info);
+      }
+#else
+      text = mapFile(tj, path, fd, &info);
+#endif
+    }
+  }
+  if (tj->options.results != NULL && text->buffer != NULL && text->buffer->kind != HEAP_BUFFER) {
+    recallFileHash(tj, text->buffer, &info);
+  }
+  storeText(tj, &tj->variables[instruction->a].value, text);
+}
+
+static void executeWrite(TJInterpreter *tj, Instruction *instruction) {
+  const char *path = ropeBytes(tj, tj->variables[instruction->b].value.text);
+#ifdef HAVE_THREADS
+  PendingWrite *pending = tj->io != NULL ? reserveWrite(tj) : NULL;
+#endif
+  Value value = tj->variables[instruction->a].value;
+  Rope *text = value.type == INT ? formatInt(tj, value.number) : value.text;
+  // Truncating a file that is still mapped would invalidate ropes viewing
+  // it, so such files are replaced with a new inode instead. With a shared
+  // file cache another interpreter may map it at any time, so every
+  // existing file is replaced
+  struct stat info;
+  bool replace = stat(path, &info) == 0
+              && (tj->options.files != NULL || findMappedFile(tj, info.st_dev, info.st_ino) != NULL);
+  char *target = (char*) path;
+  if (replace) {
+    target = malloc(strlen(path) + 48);
+    if (target == NULL) {
+      if (value.type == INT) {
+        releaseRope(tj, text);
+      }
+      raiseError(tj, "Out of memory!");
+    }
+    sprintf(target, "%s.%ld.%lx.tmp", path, (long) getpid(), (unsigned long) (uintptr_t) tj);
+  }
+#ifdef HAVE_THREADS
+  if (pending != NULL) {
+    gatherVectors(tj, text, pending);
+    submitWrite(tj, pending, path, replace ? target : NULL, value.type == INT ? text : retainRope(tj, text));
+    return;
+  }
+#endif
+  int fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    if (replace) {
+      free(target);
+    }
+    if (value.type == INT) {
+      releaseRope(tj, text);
+    }
+    raiseError(tj, "File not found!");
+  }
+  MappedFile *original = findMappedSource(tj, text);
+  size_t copied = original != NULL ? copyMappedFile(original, fd) : 0;
+  bool written = copied > 0
+               ? writeBytes(fd, original->buffer->bytes + copied, original->buffer->length - copied)
+               : writeRope(fd, text);
+  written = close(fd) == 0 && written;
+  if (value.type == INT) {
+    releaseRope(tj, text);
+  }
+  if (replace) {
+    written = written && rename(target, path) == 0;
+    if (!written) {
+      unlink(target);
+    }
+    free(target);
+  }
+  if (!written) {
+    raiseError(tj, "Cannot write file!");
+  }
+}
+#else
+// Without mmap every interpreter reads its own copy
+TJFileCache* tjCreateFileCache(void) {
+  return NULL;
+}
+
+void tjDestroyFileCache(TJFileCache *cache) {
+  (void) cache;
+}
+
+static void executeRead(TJInterpreter *tj, Instruction *instruction) {
+  FILE *file = fopen(ropeBytes(tj, tj->variables[instruction->b].value.text), "rb");
+  if (file == NULL) {
+    raiseError(tj, "File not found!");
+  }
+  fseek(file, 0, SEEK_END);
+  long fsize = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  Buffer *buffer = fsize < 0 ? NULL : tryNewBuffer(tj, fsize);
+  if (buffer == NULL) {
+    fclose(file);
+    raiseError(tj, fsize < 0 ? "Cannot read file!" : "Out of memory!");
+  }
+  buffer->length = fread(buffer->bytes, 1, fsize, file);
+  buffer->bytes[buffer->length] = '\0';
+  fclose(file);
+  storeText(tj, &tj->variables[instruction->a].value, ropeLeaf(tj, buffer, buffer->bytes, buffer->length));
+}
+
+static void executeWrite(TJInterpreter *tj, Instruction *instruction) {
+  FILE *file = fopen(ropeBytes(tj, tj->variables[instruction->b].value.text), "wb");
+  if (file == NULL) {
+    raiseError(tj, "File not found!");
+  }
+  printValue(file, tj->variables[instruction->a].value);
+  fclose(file);
+}
+#endif
+
+static Rope* removeFunc(TJInterpreter *tj, Rope *value1, Rope *value2) {
+  if (value1->length < value2->length) {
+    raiseError(tj, "The subtrahend cannot be longer than the minuend!");
+  }
+  if (value2->length == 0) {
+    return retainRope(tj, value1);
+  }
+  size_t found;
+  CachedResult query;
+  bool cached = searchKey(tj, value1, value2, 0, &query);
+  if (!cached || !findResult(tj, &query, &found)) {
+    found = searchRope(tj, value1, ropeBytes(tj, value2), value2->length, 0);
+    if (cached) {
+      addResult(tj, &query, found);
+    }
+  }
+  if (found == NOT_FOUND) {
+    return retainRope(tj, value1);
+  }
+  Rope *left, *right;
+  ropeSplit(tj, retainRope(tj, value1), found, &left, &right);
+  return ropeConcat(tj, left, ropeSlice(tj, right, value2->length, right->length));
+}
+
+// Seconds on a monotonic clock
+static double now() {
+  struct timespec time;
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &time);
+#else
+  timespec_get(&time, TIME_UTC);
+#endif
+  return (double) time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Per opcode: name, how many of b, c, d are operands, whether a is read
+// rather than written
+typedef struct {
+  const char* name;
+  int operands;
+  bool readsA;
+} OpInfo;
+
+static const OpInfo OP_INFO[] = {
+  [OP_HALT] = {"halt", 0, false},
+  [OP_OUTPUT] = {"output", 0, true},
+  [OP_INPUT] = {"input", 1, false},
+  [OP_READ] = {"read", 0, false},
+  [OP_WRITE] = {"write", 0, true},
+  [OP_MOVE] = {"assign", 1, false},
+  [OP_SIZE] = {"size", 1, false},
+  [OP_SUBS] = {"subs", 3, false},
+  [OP_LOCATE] = {"locate", 3, false},
+  [OP_AS_STRING] = {"asString", 1, false},
+  [OP_AS_TEXT] = {"asText", 1, false},
+  [OP_INSERT] = {"insert", 3, false},
+  [OP_OVERRIDE] = {"override", 3, false},
+  [OP_ADD] = {"int +", 2, false},
+  [OP_SUB] = {"int -", 2, false},
+  [OP_CONCAT] = {"text +", 2, false},
+  [OP_REMOVE] = {"text -", 2, false},
+  [OP_JOIN] = {"text join", 0, false},
+  [OP_LOOP] = {"loop", 1, false},
+  [OP_END_LOOP] = {"loop end", 0, true},
+  [OP_APPEND_SUBS] = {"subs +", 3, true}
+};
+
+static int operandCount(Instruction *instruction) {
+  return instruction->op == OP_JOIN ? instruction->c : OP_INFO[instruction->op].operands;
+}
+
+static int* operandOf(TJInterpreter *tj, Instruction *instruction, int i) {
+  if (instruction->op == OP_JOIN) {
+    return &tj->program.operands[instruction->b + i];
+  }
+  return i == 0 ? &instruction->b : i == 1 ? &instruction->c : &instruction->d;
+}
+
+//OPTIMIZER
+
+// Every user variable maps to the constant slot holding its current value
+// (knownValues), or -1 once it depends on input. Reads of known variables
+// are replaced by the constant, so a store of a constant is never read and
+// is dropped. constantUses counts references from known values and kept
+// instructions; constants made by folding are freed and their slots reused
+// when it drops to 0.
+
+static bool isConstant(TJInterpreter *tj, int slot) {
+  return tj->variables[slot].name == NULL;
+}
+
+static void useConstant(TJInterpreter *tj, int slot) {
+  if (slot < (int) tj->userSlots) {
+    return;
+  }
+  if ((size_t) slot >= tj->constantUsesCapacity) {
+    size_t capacity = tj->constantUsesCapacity;
+    while ((size_t) slot >= capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+    }
+    tj->constantUses = realloc(tj->constantUses, capacity * sizeof(int));
+    if (tj->constantUses == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+    memset(tj->constantUses + tj->constantUsesCapacity, 0, (capacity - tj->constantUsesCapacity) * sizeof(int));
+    tj->constantUsesCapacity = capacity;
+  }
+  tj->constantUses[slot]++;
+}
+
+static void dropConstant(TJInterpreter *tj, int slot) {
+  if (slot < (int) tj->userSlots || --tj->constantUses[slot] > 0) {
+    return;
+  }
+  if (tj->variables[slot].value.type == TEXT) {
+    setText(tj, &tj->variables[slot].value, &emptyRope);
+  }
+  tj->freeConstants[tj->freeConstantsSize++] = slot;
+}
+
+static int addFoldedConstant(TJInterpreter *tj, Value value) {
+  if (tj->freeConstantsSize > 0) {
+    int slot = tj->freeConstants[--tj->freeConstantsSize];
+    tj->variables[slot].value = value;
+    return slot;
+  }
+  if (tj->variablesSize - tj->userSlots == tj->freeConstantsCapacity) {
+    tj->freeConstantsCapacity = tj->freeConstantsCapacity == 0 ? 64 : tj->freeConstantsCapacity * 2;
+    tj->freeConstants = realloc(tj->freeConstants, tj->freeConstantsCapacity * sizeof(int));
+    if (tj->freeConstants == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  return addVariable(tj, NULL, value);
+}
+
+static void setKnownValue(TJInterpreter *tj, int slot, int constant) {
+  int old = tj->knownValues[slot];
+  useConstant(tj, constant);
+  tj->knownValues[slot] = constant;
+  dropConstant(tj, old);
+}
+
+// Evaluates a pure instruction whose operands are all constants with the
+// same kernels as the VM; false if it would raise an error, which is then
+// left to happen at run time
+static bool foldInstruction(TJInterpreter *tj, Instruction *instruction, Value *result) {
+  if (instruction->op == OP_JOIN) {
+    *result = (Value) {TEXT, .text = joinFunc(tj, &tj->program.operands[instruction->b], instruction->c)};
+    return true;
+  }
+  Value *b = &tj->variables[instruction->b].value;
+  Value *c = &tj->variables[instruction->c].value;
+  Value *d = &tj->variables[instruction->d].value;
+  switch (instruction->op) {
+    case OP_SIZE:
+      *result = (Value) {INT, .number = sizeFunc(b->text)};
+      return true;
+    case OP_SUBS:
+      *result = (Value) {TEXT, .text = subsFunc(tj, b->text, c->number, d->number)};
+      return true;
+    case OP_LOCATE:
+      *result = (Value) {INT, .number = locateFunc(ropeBytes(tj, b->text), b->text->length,
+                                                   ropeBytes(tj, c->text), c->text->length, d->number)};
+      return true;
+    case OP_AS_STRING:
+      *result = (Value) {TEXT, .text = formatInt(tj, b->number)};
+      return true;
+    case OP_AS_TEXT:
+      *result = (Value) {INT, .number = parseInt(b->text)};
+      return true;
+    case OP_INSERT:
+      *result = (Value) {TEXT, .text = insertFunc(tj, b->text, c->number, d->text)};
+      return true;
+    case OP_OVERRIDE:
+      *result = (Value) {TEXT, .text = overrideFunc(tj, b->text, c->number, d->text)};
+      return true;
+    case OP_ADD:
+      *result = (Value) {INT, .number = b->number + c->number};
+      return true;
+    case OP_SUB:
+      *result = (Value) {INT, .number = b->number - c->number};
+      return result->number >= 0;
+    case OP_CONCAT:
+      *result = (Value) {TEXT, .text = ropeConcat(tj, retainRope(tj, b->text), retainRope(tj, c->text))};
+      return true;
+    case OP_REMOVE:
+      if (b->text->length < c->text->length) {
+        return false;
+      }
+      *result = (Value) {TEXT, .text = removeFunc(tj, b->text, c->text)};
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Stores whose value is overwritten before it is read; SUB and REMOVE may
+// raise an error and I/O has side effects, so those always stay
+static bool isRemovableStore(OpCode op) {
+  return op != OP_HALT && op != OP_OUTPUT && op != OP_INPUT && op != OP_READ && op != OP_WRITE
+      && op != OP_SUB && op != OP_REMOVE && op != OP_LOOP && op != OP_END_LOOP;
+}
+
+// Everything a loop body reads is live at its end, since the next
+// iteration may read it
+static void markLoopReads(TJInterpreter *tj, bool *live, int loop, int end) {
+  for (int i = loop + 1; i < end; i++) {
+    Instruction *instruction = &tj->program.code[i];
+    if (OP_INFO[instruction->op].readsA) {
+      live[instruction->a] = true;
+    }
+    for (int j = 0; j < operandCount(instruction); j++) {
+      live[*operandOf(tj, instruction, j)] = true;
+    }
+  }
+}
+
+// Drops stores that are never read, walking backwards from the end of the
+// program where no variable is live. Stores inside loops always stay and do
+// not end liveness, so what is live after a loop is live before it too
+static void eliminateDeadStores(TJInterpreter *tj) {
+  bool *live = calloc(tj->variablesSize, sizeof(bool));
+  bool *dead = calloc(tj->program.size, sizeof(bool));
+  if (live == NULL || dead == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  int loops = 0;
+  for (size_t i = tj->program.size; i-- > 0;) {
+    Instruction *instruction = &tj->program.code[i];
+    OpInfo info = OP_INFO[instruction->op];
+    if (instruction->op == OP_END_LOOP) {
+      markLoopReads(tj, live, instruction->b, (int) i);
+      loops++;
+    } else if (instruction->op == OP_LOOP) {
+      loops--;
+    }
+    if (instruction->op != OP_HALT && !info.readsA && loops == 0) {
+      if (!live[instruction->a] && isRemovableStore(instruction->op)) {
+        dead[i] = true;
+        continue;
+      }
+      live[instruction->a] = false;
+    }
+    if (info.readsA) {
+      live[instruction->a] = true;
+    }
+    for (int j = 0; j < operandCount(instruction); j++) {
+      live[*operandOf(tj, instruction, j)] = true;
+    }
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < tj->program.size; i++) {
+    if (!dead[i]) {
+      tj->program.code[size++] = tj->program.code[i];
+    }
+  }
+  tj->program.size = size;
+  free(live);
+  free(dead);
+}
+
+static bool isTemporary(TJInterpreter *tj, int slot) {
+  return tj->variables[slot].name != NULL && tj->variables[slot].name[0] == '\0';
+}
+
+// Variables assigned in a loop body change from one iteration to the next.
+// Their known values are stored before the loop, since the stores that set
+// them were dropped, and forgotten for the body. Temporaries and counters
+// are always written before they are read
+static void enterLoop(TJInterpreter *tj, Instruction *code, size_t loop) {
+  for (int i = (int) loop + 1; i < code[loop].c; i++) {
+    int slot = code[i].a;
+    if (code[i].op == OP_HALT || OP_INFO[code[i].op].readsA || tj->knownValues[slot] < 0) {
+      continue;
+    }
+    if (!isTemporary(tj, slot)) {
+      Instruction store = {OP_MOVE, code[loop].line, slot, tj->knownValues[slot], 0, 0};
+      useConstant(tj, store.b);
+      appendInstruction(tj, store);
+    }
+    setKnownValue(tj, slot, -1);
+  }
+}
+
+// Superinstructions for loop bodies, where dispatch and allocations repeat
+// every iteration: `x := x + subs(t, i, j)` compiles to a subs into a
+// temporary and a concat, fused into one OP_APPEND_SUBS on x
+static void fuseLoopBodies(TJInterpreter *tj) {
+  Instruction *code = tj->program.code;
+  int loops = 0;
+  size_t size = 0;
+  for (size_t i = 0; i < tj->program.size; i++) {
+    Instruction instruction = code[i];
+    if (instruction.op == OP_LOOP) {
+      loops++;
+    } else if (instruction.op == OP_END_LOOP) {
+      loops--;
+    }
+    if (loops > 0 && instruction.op == OP_SUBS && i + 1 < tj->program.size && isTemporary(tj, instruction.a)) {
+      Instruction next = code[i + 1];
+      if (next.op == OP_CONCAT && next.c == instruction.a && next.a == next.b && next.a != instruction.a) {
+        Instruction fused = {OP_APPEND_SUBS, next.line, next.a, instruction.b, instruction.c, instruction.d};
+        code[size++] = fused;
+        i++;
+        continue;
+      }
+    }
+    code[size++] = instruction;
+  }
+  tj->program.size = size;
+}
+
+// Folds instructions on constants, propagates constants through variables
+// and removes the stores that become dead. Runs once over the compiled
+// program; its only jumps are loops, whose bodies keep their stores and see
+// no known values for what they assign, so a single forward pass is enough
+static void freeOptimizer(TJInterpreter *tj) {
+  free(tj->knownValues);
+  free(tj->constantUses);
+  free(tj->freeConstants);
+  tj->knownValues = NULL;
+  tj->constantUses = NULL;
+  tj->freeConstants = NULL;
+  tj->constantUsesCapacity = 0;
+  tj->freeConstantsSize = 0;
+  tj->freeConstantsCapacity = 0;
+}
+
+static void optimizeProgram(TJInterpreter *tj) {
+  Value zero = {INT, .number = 0};
+  Value empty = {TEXT, .text = &emptyRope};
+  int zeroConstant = addVariable(tj, NULL, zero);
+  int emptyConstant = addVariable(tj, NULL, empty);
+  // Slots from here on hold folded constants
+  tj->userSlots = tj->variablesSize;
+  tj->knownValues = malloc(tj->userSlots * sizeof(int));
+  if (tj->knownValues == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  for (size_t slot = 0; slot < tj->userSlots; slot++) {
+    tj->knownValues[slot] = isConstant(tj, slot) ? -1 : tj->variables[slot].value.type == INT ? zeroConstant : emptyConstant;
+  }
+
+  // Stores of known values before loops are added, so the program is
+  // rebuilt from a copy
+  size_t count = tj->program.size;
+  Instruction *code = malloc(count * sizeof(Instruction));
+  if (code == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+  memcpy(code, tj->program.code, count * sizeof(Instruction));
+  tj->program.size = 0;
+  int loops = 0;
+  for (size_t i = 0; i < count; i++) {
+    Instruction instruction = code[i];
+    OpInfo info = OP_INFO[instruction.op];
+    bool constantOperands = operandCount(&instruction) > 0;
+    for (int j = 0; j < operandCount(&instruction); j++) {
+      int *operand = operandOf(tj, &instruction, j);
+      if (!isConstant(tj, *operand) && tj->knownValues[*operand] >= 0) {
+        *operand = tj->knownValues[*operand];
+      }
+      constantOperands = constantOperands && isConstant(tj, *operand);
+    }
+    if (info.readsA && !isConstant(tj, instruction.a) && tj->knownValues[instruction.a] >= 0) {
+      instruction.a = tj->knownValues[instruction.a];
+    }
+    if (instruction.op == OP_LOOP) {
+      enterLoop(tj, code, i);
+      loops++;
+    } else if (instruction.op == OP_END_LOOP) {
+      loops--;
+    }
+    Value value;
+    if (instruction.op == OP_MOVE && constantOperands && loops == 0) {
+      setKnownValue(tj, instruction.a, instruction.b);
+      continue;
+    }
+    if (constantOperands && foldInstruction(tj, &instruction, &value)) {
+      int constant = addFoldedConstant(tj, value);
+      if (loops == 0) {
+        setKnownValue(tj, instruction.a, constant);
+        continue;
+      }
+      instruction = (Instruction) {OP_MOVE, instruction.line, instruction.a, constant, 0, 0};
+    }
+    for (int j = 0; j < operandCount(&instruction); j++) {
+      useConstant(tj, *operandOf(tj, &instruction, j));
+    }
+    if (info.readsA) {
+      useConstant(tj, instruction.a);
+    } else if (instruction.op != OP_HALT) {
+      setKnownValue(tj, instruction.a, -1);
+    }
+    appendInstruction(tj, instruction);
+  }
+  free(code);
+  linkLoops(tj);
+  eliminateDeadStores(tj);
+  linkLoops(tj);
+  fuseLoopBodies(tj);
+  linkLoops(tj);
+  freeOptimizer(tj);
+}
+
+//CACHE
+
+// A compiled program is saved next to its source as <source>c (or
+// <source>.tjc) and reused while the source hash, the format version and
+// the optimizer setting match and its checksum is intact. Layout:
+// CacheHeader, one CachedVariable per slot, the instructions, the join
+// operands, then names and texts, each followed by a NUL byte so file
+// names can be passed to open directly.
+#define CACHE_MAGIC   0x434a5454u // "TTJC"
+#define CACHE_VERSION 2
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint64_t sourceLength;
+  uint64_t checksum; // of everything after the header
+  uint32_t optimized;
+  uint32_t statements;
+  uint64_t variables;
+  uint64_t instructions;
+  uint64_t operands;
+} CacheHeader;
+
+typedef struct {
+  int32_t type;
+  int32_t named;
+  int64_t number;
+  uint64_t textOffset;
+  uint64_t textLength;
+  uint64_t nameOffset;
+} CachedVariable;
+
+static char* cachePathOf(TJInterpreter *tj, const char *file) {
+  size_t length = strlen(file);
+  char *path = allocate(tj, length + 5);
+  strcpy(path, file);
+  strcat(path, length > 3 && strcmp(file + length - 3, ".tj") == 0 ? "c" : ".tjc");
+  return path;
+}
+
+#ifdef HAVE_MMAP
+static uint64_t hashBytes(const char *bytes, size_t length) {
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char) bytes[i]) * 1099511628211u;
+  }
+  return hash;
+}
+
+static uint64_t hashSource(TJInterpreter *tj) {
+  if (tj->sourceHash == 0) {
+    tj->sourceHash = hashBytes(tj->source, tj->sourceEnd - tj->source);
+  }
+  return tj->sourceHash;
+}
+
+static bool validCachedInstruction(Instruction *instruction, uint64_t index, const CacheHeader *header) {
+  if ((unsigned) instruction->op >= OP_COUNT) {
+    return false;
+  }
+  if (instruction->op == OP_JOIN) {
+    return instruction->b >= 0 && instruction->c >= 0
+        && (uint64_t) instruction->b + instruction->c <= header->operands;
+  }
+  // Loops jump forward to their end and ends back to their loop
+  int slots[4] = {instruction->a, instruction->b, instruction->c, instruction->d};
+  if (instruction->op == OP_LOOP) {
+    if (instruction->c < 0 || (uint64_t) instruction->c <= index || (uint64_t) instruction->c >= header->instructions) {
+      return false;
+    }
+    slots[2] = 0;
+  } else if (instruction->op == OP_END_LOOP) {
+    if (instruction->b < 0 || (uint64_t) instruction->b >= index) {
+      return false;
+    }
+    slots[1] = 0;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (slots[i] < 0 || (uint64_t) slots[i] >= header->variables) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Loads the program from the cache; false if it is missing or stale. The
+// mapping stays for the whole run: instructions and texts point into it
+static bool loadCache(TJInterpreter *tj, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t) info.st_size;
+  char *bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    return false;
+  }
+  const CacheHeader *header = (const CacheHeader*) bytes;
+  size_t tables = sizeof(CacheHeader) + header->variables * sizeof(CachedVariable)
+                + header->instructions * sizeof(Instruction) + header->operands * sizeof(int);
+  if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION || header->optimized != tj->options.optimize
+      || header->sourceLength != (uint64_t) (tj->sourceEnd - tj->source) || header->sourceHash != hashSource(tj)
+      || header->variables > size || header->instructions > size || header->operands > size || tables > size
+      || header->checksum != hashBytes(bytes + sizeof(CacheHeader), size - sizeof(CacheHeader))) {
+    munmap(bytes, size);
+    return false;
+  }
+  const CachedVariable *cached = (const CachedVariable*) (header + 1);
+  Instruction *code = (Instruction*) (cached + header->variables);
+  int *operands = (int*) (code + header->instructions);
+  for (uint64_t i = 0; i < header->instructions; i++) {
+    if (!validCachedInstruction(&code[i], i, header)) {
+      munmap(bytes, size);
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < header->operands; i++) {
+    if (operands[i] < 0 || (uint64_t) operands[i] >= header->variables) {
+      munmap(bytes, size);
+      return false;
+    }
+  }
+  size_t texts = size - tables;
+  for (uint64_t i = 0; i < header->variables; i++) {
+    if ((cached[i].type != INT && cached[i].type != TEXT)
+        || (cached[i].type == TEXT && (cached[i].textOffset > texts || cached[i].textLength >= texts - cached[i].textOffset))
+        || (cached[i].named && cached[i].nameOffset >= texts)) {
+      munmap(bytes, size);
+      return false;
+    }
+  }
+  // Never released, so the mapping outlives every leaf viewing it
+  Buffer *buffer = tj->cacheBuffer = allocate(tj, sizeof(Buffer));
+  buffer->references = 1;
+  buffer->kind = MAPPED_BUFFER;
+  buffer->bytes = bytes;
+  buffer->length = size;
+  buffer->scanned = 0;
+  buffer->index = NULL;
+  buffer->hash = 0;
+  for (uint64_t i = 0; i < header->variables; i++) {
+    Value value = {.type = cached[i].type};
+    if (value.type == TEXT) {
+      const char *text = bytes + tables + cached[i].textOffset;
+      value.text = cached[i].textLength == 0 ? &emptyRope : ropeLeaf(tj, buffer, text, cached[i].textLength);
+    } else {
+      value.number = cached[i].number;
+    }
+    addVariable(tj, cached[i].named ? bytes + tables + cached[i].nameOffset : NULL, value);
+  }
+  // Tables kept warm by a reset are not needed while the mapping is used
+  free(tj->program.code);
+  free(tj->program.operands);
+  tj->program.capacity = 0;
+  tj->program.operandsCapacity = 0;
+  tj->program.code = code;
+  tj->program.size = header->instructions;
+  tj->program.operands = operands;
+  tj->program.operandsSize = header->operands;
+  tj->programMapped = true;
+  tj->compiledLines = (int) header->statements;
+  return true;
+}
+
+typedef struct {
+  char* bytes;
+  size_t size;
+  size_t capacity;
+} CacheWriter;
+
+static char* reserveCache(TJInterpreter *tj, CacheWriter *writer, size_t size) {
+  while (writer->size + size > writer->capacity) {
+    writer->capacity = writer->capacity == 0 ? 4096 : writer->capacity * 2;
+    writer->bytes = realloc(writer->bytes, writer->capacity);
+    if (writer->bytes == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  char *bytes = writer->bytes + writer->size;
+  writer->size += size;
+  return bytes;
+}
+
+static void appendCache(TJInterpreter *tj, CacheWriter *writer, const void *bytes, size_t size) {
+  if (size > 0) {
+    memcpy(reserveCache(tj, writer, size), bytes, size);
+  }
+}
+
+// Writes the compiled program to a temporary file renamed over the cache,
+// so concurrent runs never see a partial cache. Failures are ignored
+static void saveCache(TJInterpreter *tj, const char *path) {
+  CacheWriter writer = {NULL, 0, 0};
+  CacheHeader header = {CACHE_MAGIC, CACHE_VERSION, hashSource(tj), (uint64_t) (tj->sourceEnd - tj->source), 0, tj->options.optimize,
+                        (uint32_t) tj->compiledLines, tj->variablesSize, tj->program.size, tj->program.operandsSize};
+  appendCache(tj, &writer, &header, sizeof(header));
+  uint64_t offset = 0;
+  for (size_t i = 0; i < tj->variablesSize; i++) {
+    Value value = tj->variables[i].value;
+    CachedVariable cached = {.type = value.type, .named = tj->variables[i].name != NULL};
+    if (value.type == TEXT) {
+      cached.textOffset = offset;
+      cached.textLength = value.text->length;
+      offset += value.text->length + 1;
+    } else {
+      cached.number = value.number;
+    }
+    if (cached.named) {
+      cached.nameOffset = offset;
+      offset += strlen(tj->variables[i].name) + 1;
+    }
+    appendCache(tj, &writer, &cached, sizeof(cached));
+  }
+  appendCache(tj, &writer, tj->program.code, tj->program.size * sizeof(Instruction));
+  appendCache(tj, &writer, tj->program.operands, tj->program.operandsSize * sizeof(int));
+  for (size_t i = 0; i < tj->variablesSize; i++) {
+    if (tj->variables[i].value.type == TEXT) {
+      Rope *text = tj->variables[i].value.text;
+      char *bytes = reserveCache(tj, &writer, text->length + 1);
+      ropeCopy(text, bytes);
+      bytes[text->length] = '\0';
+    }
+    if (tj->variables[i].name != NULL) {
+      appendCache(tj, &writer, tj->variables[i].name, strlen(tj->variables[i].name) + 1);
+    }
+  }
+  ((CacheHeader*) writer.bytes)->checksum = hashBytes(writer.bytes + sizeof(header), writer.size - sizeof(header));
+
+  char *temporary = allocate(tj, strlen(path) + 48);
+  sprintf(temporary, "%s.%ld.%lx.tmp", path, (long) getpid(), (unsigned long) (uintptr_t) tj);
+  int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0) {
+    bool written = write(fd, writer.bytes, writer.size) == (ssize_t) writer.size;
+    if (close(fd) != 0 || !written || rename(temporary, path) != 0) {
+      unlink(temporary);
+    }
+  }
+  free(temporary);
+  free(writer.bytes);
+}
+#else
+static bool loadCache(TJInterpreter *tj, const char *path) {
+  (void) tj;
+  (void) path;
+  return false;
+}
+
+static void saveCache(TJInterpreter *tj, const char *path) {
+  (void) tj;
+  (void) path;
+}
+#endif
+
+
+static size_t textOperandBytes(TJInterpreter *tj, Instruction *instruction) {
+  size_t bytes = 0;
+  for (int i = 0; i < operandCount(instruction); i++) {
+    Value operand = tj->variables[*operandOf(tj, instruction, i)].value;
+    if (operand.type == TEXT) {
+      bytes += operand.text->length;
+    }
+  }
+  if (OP_INFO[instruction->op].readsA && tj->variables[instruction->a].value.type == TEXT) {
+    bytes += tj->variables[instruction->a].value.text->length;
+  }
+  return bytes;
+}
+
+static void recordProfile(ProfileEntry *entry, double seconds, size_t allocated, size_t text) {
+  entry->count++;
+  entry->totalSeconds += seconds;
+  if (seconds > entry->maxSeconds) {
+    entry->maxSeconds = seconds;
+  }
+  entry->allocatedBytes += allocated;
+  entry->textBytes += text;
+}
+
+// Called before every instruction while profiling: closes the measurement
+// of the previous instruction and opens one for the next
+static void profileStep(TJInterpreter *tj, Instruction *next) {
+  double time = now();
+  Instruction *previous = tj->profiledInstruction;
+  if (previous != NULL) {
+    double seconds = time - tj->profileStart;
+    size_t allocated = tj->bytesAllocated - tj->profileAllocated;
+    size_t text = tj->profileText;
+    if (previous->op == OP_READ && tj->variables[previous->a].value.type == TEXT) {
+      text += tj->variables[previous->a].value.text->length;
+    }
+    recordProfile(&tj->opProfile[previous->op], seconds, allocated, text);
+    recordProfile(&tj->lineProfile[previous->line], seconds, allocated, text);
+  }
+  tj->profiledInstruction = next->op == OP_HALT ? NULL : next;
+  if (tj->profiledInstruction != NULL) {
+    tj->profileText = textOperandBytes(tj, next);
+    tj->profileAllocated = tj->bytesAllocated;
+    tj->profileStart = now();
+  }
+}
+
+static void printProfileJson(TJInterpreter *tj, FILE *file) {
+  fprintf(file, "{\"statements\": [");
+  bool first = true;
+  for (int op = 0; op < OP_COUNT; op++) {
+    ProfileEntry *entry = &tj->opProfile[op];
+    if (entry->count == 0) {
+      continue;
+    }
+    fprintf(file, "%s\n  {\"kind\": \"%s\", \"count\": %ld, \"total_seconds\": %.9f, \"mean_seconds\": %.9f, "
+                    "\"max_seconds\": %.9f, \"allocated_bytes\": %zu, \"text_bytes\": %zu}",
+            first ? "" : ",", OP_INFO[op].name, entry->count, entry->totalSeconds,
+            entry->totalSeconds / entry->count, entry->maxSeconds, entry->allocatedBytes, entry->textBytes);
+    first = false;
+  }
+  fprintf(file, "\n], \"lines\": [");
+  first = true;
+  for (int line = 0; line < tj->profiledLines; line++) {
+    ProfileEntry *entry = &tj->lineProfile[line];
+    if (entry->count == 0) {
+      continue;
+    }
+    fprintf(file, "%s\n  {\"line\": %d, \"count\": %ld, \"total_seconds\": %.9f, \"max_seconds\": %.9f, "
+                    "\"allocated_bytes\": %zu, \"text_bytes\": %zu}",
+            first ? "" : ",", line, entry->count, entry->totalSeconds, entry->maxSeconds,
+            entry->allocatedBytes, entry->textBytes);
+    first = false;
+  }
+  fprintf(file, "\n]}\n");
+}
+
+typedef struct {
+  int line;
+  double seconds;
+} LineTime;
+
+static int compareLineTime(const void *left, const void *right) {
+  double difference = ((const LineTime*) right)->seconds - ((const LineTime*) left)->seconds;
+  return (difference > 0) - (difference < 0);
+}
+
+// Statement kinds in opcode order, then the 20 slowest lines
+static void printProfileTable(TJInterpreter *tj, FILE *file) {
+  fprintf(file, "%-10s %10s %12s %12s %12s %14s %14s\n",
+          "statement", "count", "total ms", "mean us", "max us", "allocated", "text bytes");
+  for (int op = 0; op < OP_COUNT; op++) {
+    ProfileEntry *entry = &tj->opProfile[op];
+    if (entry->count == 0) {
+      continue;
+    }
+    fprintf(file, "%-10s %10ld %12.3f %12.3f %12.3f %14zu %14zu\n", OP_INFO[op].name, entry->count,
+            entry->totalSeconds * 1e3, entry->totalSeconds / entry->count * 1e6, entry->maxSeconds * 1e6,
+            entry->allocatedBytes, entry->textBytes);
+  }
+  LineTime *lines = malloc(tj->profiledLines * sizeof(LineTime));
+  if (lines == NULL) {
+    return;
+  }
+  int lineCount = 0;
+  for (int line = 0; line < tj->profiledLines; line++) {
+    if (tj->lineProfile[line].count > 0) {
+      lines[lineCount].line = line;
+      lines[lineCount++].seconds = tj->lineProfile[line].totalSeconds;
+    }
+  }
+  qsort(lines, lineCount, sizeof(LineTime), compareLineTime);
+  fprintf(file, "\n%-10s %10s %12s %12s %14s %14s\n", "line", "count", "total ms", "max us", "allocated", "text bytes");
+  for (int i = 0; i < lineCount && i < 20; i++) {
+    ProfileEntry *entry = &tj->lineProfile[lines[i].line];
+    fprintf(file, "%-10d %10ld %12.3f %12.3f %14zu %14zu\n", lines[i].line, entry->count, entry->totalSeconds * 1e3,
+            entry->maxSeconds * 1e6, entry->allocatedBytes, entry->textBytes);
+  }
+  free(lines);
+}
+
+static void startProfiling(TJInterpreter *tj) {
+  free(tj->lineProfile);
+  memset(tj->opProfile, 0, sizeof(tj->opProfile));
+  tj->profiledInstruction = NULL;
+  tj->profiledLines = tj->compiledLines + 1;
+  tj->lineProfile = calloc(tj->profiledLines, sizeof(ProfileEntry));
+  if (tj->lineProfile == NULL) {
+    raiseError(tj, "Out of memory!");
+  }
+}
+
+// Computed goto on GCC/Clang, a plain switch everywhere else
+#if defined(__GNUC__)
+#define VM_SWITCH goto *dispatchTable[ip->op];
+#define VM_CASE(op) label_##op
+#define VM_NEXT() ip++; tj->currentLine = ip->line; if (tj->options.profile) { profileStep(tj, ip); } goto *dispatchTable[ip->op]
+#else
+#define VM_SWITCH switch (ip->op)
+#define VM_CASE(op) case op
+#define VM_NEXT() ip++; continue
+#endif
+
+// Runs from ip until the next OP_HALT
+static void runProgram(TJInterpreter *tj, Instruction *ip) {
+  Variable *v = tj->variables;
+#if defined(__GNUC__)
+  static void *dispatchTable[] = {
+    &&label_OP_HALT, &&label_OP_OUTPUT, &&label_OP_INPUT, &&label_OP_READ, &&label_OP_WRITE, &&label_OP_MOVE,
+    &&label_OP_SIZE, &&label_OP_SUBS, &&label_OP_LOCATE, &&label_OP_AS_STRING, &&label_OP_AS_TEXT,
+    &&label_OP_INSERT, &&label_OP_OVERRIDE, &&label_OP_ADD, &&label_OP_SUB, &&label_OP_CONCAT, &&label_OP_REMOVE,
+    &&label_OP_JOIN, &&label_OP_LOOP, &&label_OP_END_LOOP, &&label_OP_APPEND_SUBS
+  };
+#endif
+  for (;;) {
+    tj->currentLine = ip->line;
+    if (tj->options.profile) {
+      profileStep(tj, ip);
+    }
+    VM_SWITCH {
+      VM_CASE(OP_HALT):
+        return;
+      VM_CASE(OP_OUTPUT):
+        outputValue(tj, v[ip->a].value);
+        writeOutput(tj, "\n", 1);
+        VM_NEXT();
+      VM_CASE(OP_INPUT):
+        executeInput(tj, ip);
+        VM_NEXT();
+      VM_CASE(OP_READ):
+        executeRead(tj, ip);
+        VM_NEXT();
+      VM_CASE(OP_WRITE):
+        executeWrite(tj, ip);
+        VM_NEXT();
+      VM_CASE(OP_MOVE):
+        if (v[ip->a].value.type == TEXT) {
+          setText(tj, &v[ip->a].value, retainRope(tj, v[ip->b].value.text));
+        } else {
+          v[ip->a].value.number = v[ip->b].value.number;
+        }
+        VM_NEXT();
+      VM_CASE(OP_SIZE):
+        v[ip->a].value.number = sizeFunc(v[ip->b].value.text);
+        VM_NEXT();
+      VM_CASE(OP_SUBS):
+        setText(tj, &v[ip->a].value, subsFunc(tj, v[ip->b].value.text, v[ip->c].value.number, v[ip->d].value.number));
+        VM_NEXT();
+      VM_CASE(OP_LOCATE):
+        v[ip->a].value.number = locateText(tj, v[ip->b].value.text, v[ip->c].value.text, v[ip->d].value.number);
+        VM_NEXT();
+      VM_CASE(OP_AS_STRING):
+        setText(tj, &v[ip->a].value, formatInt(tj, v[ip->b].value.number));
+        VM_NEXT();
+      VM_CASE(OP_AS_TEXT):
+        v[ip->a].value.number = parseInt(v[ip->b].value.text);
+        VM_NEXT();
+      VM_CASE(OP_INSERT):
+        setText(tj, &v[ip->a].value, insertFunc(tj, v[ip->b].value.text, v[ip->c].value.number, v[ip->d].value.text));
+        VM_NEXT();
+      VM_CASE(OP_OVERRIDE):
+        setText(tj, &v[ip->a].value, overrideFunc(tj, v[ip->b].value.text, v[ip->c].value.number, v[ip->d].value.text));
+        VM_NEXT();
+      VM_CASE(OP_ADD):
+        v[ip->a].value.number = v[ip->b].value.number + v[ip->c].value.number;
+        VM_NEXT();
+      VM_CASE(OP_SUB):
+        v[ip->a].value.number = v[ip->b].value.number - v[ip->c].value.number;
+        if (v[ip->a].value.number < 0) {
+          raiseError(tj, "The answer cannot be negative!");
+        }
+        VM_NEXT();
+      VM_CASE(OP_CONCAT):
+        setText(tj, &v[ip->a].value, ropeConcat(tj, retainRope(tj, v[ip->b].value.text), retainRope(tj, v[ip->c].value.text)));
+        VM_NEXT();
+      VM_CASE(OP_REMOVE):
+        setText(tj, &v[ip->a].value, removeFunc(tj, v[ip->b].value.text, v[ip->c].value.text));
+        VM_NEXT();
+      VM_CASE(OP_JOIN):
+        setText(tj, &v[ip->a].value, joinFunc(tj, &tj->program.operands[ip->b], ip->c));
+        VM_NEXT();
+      VM_CASE(OP_LOOP):
+        v[ip->a].value.number = v[ip->b].value.number;
+        if (v[ip->a].value.number <= 0) {
+          ip = tj->program.code + ip->c;
+        }
+        VM_NEXT();
+      VM_CASE(OP_END_LOOP):
+        if (--v[ip->a].value.number > 0) {
+          ip = tj->program.code + ip->b;
+        }
+        VM_NEXT();
+      VM_CASE(OP_APPEND_SUBS):
+        setText(tj, &v[ip->a].value, appendSubsFunc(tj, v[ip->a].value.text, v[ip->b].value.text,
+                                                    v[ip->c].value.number, v[ip->d].value.number));
+        VM_NEXT();
+    }
+  }
+}
+
+#ifdef HAVE_THREADS
+//PARALLEL
+
+// Programs with loops run sequentially, see tjRun
+static bool hasLoops(TJInterpreter *tj) {
+  for (size_t i = 0; i < tj->program.size; i++) {
+    if (tj->program.code[i].op == OP_LOOP) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Without loops the program has no jumps, so its instructions form a DAG.
+// An instruction waits for the last writer of every slot it reads, for the
+// last writer and the readers of the slot it writes and, for read, for the
+// last write of the same file. Output, input and write wait for every instruction before
+// them, so side effects keep program order and an error stops exactly the
+// side effects it stops when running sequentially.
+typedef struct {
+  Instruction* code;
+  int count;
+  int* pending;
+  int* successorStart;
+  int* successors;
+  int* ready;
+  int readySize;
+  int completed;
+  int failedIndex;
+  char errorMessage[128];
+  int errorLine;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} Schedule;
+
+typedef struct {
+  int from;
+  int to;
+} Edge;
+
+typedef struct {
+  int instruction;
+  int next;
+} Reader;
+
+// A copy of the interpreter per thread, so errors unwind to that thread
+typedef struct {
+  TJInterpreter context;
+  Schedule* schedule;
+  pthread_t thread;
+} ParallelWorker;
+
+static bool isSideEffect(OpCode op) {
+  return op == OP_OUTPUT || op == OP_INPUT || op == OP_WRITE;
+}
+
+static void addEdge(TJInterpreter *tj, Edge **edges, size_t *size, size_t *capacity, int from, int to) {
+  if (from < 0 || from == to) {
+    return;
+  }
+  if (*size == *capacity) {
+    *capacity = *capacity == 0 ? 256 : *capacity * 2;
+    *edges = realloc(*edges, *capacity * sizeof(Edge));
+    if (*edges == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  Edge edge = {from, to};
+  (*edges)[(*size)++] = edge;
+}
+
+// Files are compared by name, since every read and write has its own constant
+static int fileIndex(Rope **files, int *fileCount, Rope *name) {
+  for (int i = 0; i < *fileCount; i++) {
+    if (files[i]->length == name->length && memcmp(files[i]->bytes, name->bytes, name->length) == 0) {
+      return i;
+    }
+  }
+  files[*fileCount] = name;
+  return (*fileCount)++;
+}
+
+static void buildSchedule(TJInterpreter *tj, Schedule *schedule) {
+  int count = (int) tj->program.size - 1;
+  size_t slots = tj->variablesSize;
+  int *lastWriter = allocate(tj, slots * sizeof(int));
+  int *readerHead = allocate(tj, slots * sizeof(int));
+  Reader *readers = allocate(tj, (4 * (size_t) count + tj->program.operandsSize + 1) * sizeof(Reader));
+  Rope **files = allocate(tj, (count + 1) * sizeof(Rope*));
+  int *fileWriter = allocate(tj, (count + 1) * sizeof(int));
+  for (size_t slot = 0; slot < slots; slot++) {
+    lastWriter[slot] = -1;
+    readerHead[slot] = -1;
+  }
+  int readerCount = 0;
+  int fileCount = 0;
+  int firstSinceEffect = 0;
+  Edge *edges = NULL;
+  size_t edgeCount = 0;
+  size_t edgeCapacity = 0;
+  for (int i = 0; i < count; i++) {
+    Instruction *instruction = &tj->program.code[i];
+    OpInfo info = OP_INFO[instruction->op];
+    int operands = operandCount(instruction);
+    for (int j = 0; j <= operands; j++) {
+      int slot;
+      if (j < operands) {
+        slot = *operandOf(tj, instruction, j);
+      } else if (info.readsA) {
+        slot = instruction->a;
+      } else {
+        break;
+      }
+      addEdge(tj, &edges, &edgeCount, &edgeCapacity, lastWriter[slot], i);
+      Reader reader = {i, readerHead[slot]};
+      readers[readerCount] = reader;
+      readerHead[slot] = readerCount++;
+    }
+    if (!info.readsA) {
+      int slot = instruction->a;
+      addEdge(tj, &edges, &edgeCount, &edgeCapacity, lastWriter[slot], i);
+      for (int reader = readerHead[slot]; reader >= 0; reader = readers[reader].next) {
+        addEdge(tj, &edges, &edgeCount, &edgeCapacity, readers[reader].instruction, i);
+      }
+      readerHead[slot] = -1;
+      lastWriter[slot] = i;
+    }
+    if (instruction->op == OP_READ || instruction->op == OP_WRITE) {
+      int previousCount = fileCount;
+      int file = fileIndex(files, &fileCount, tj->variables[instruction->b].value.text);
+      if (file == previousCount) {
+        fileWriter[file] = -1;
+      }
+      if (instruction->op == OP_READ) {
+        addEdge(tj, &edges, &edgeCount, &edgeCapacity, fileWriter[file], i);
+      } else {
+        fileWriter[file] = i;
+      }
+    }
+    if (isSideEffect(instruction->op)) {
+      for (int j = firstSinceEffect > 0 ? firstSinceEffect - 1 : 0; j < i; j++) {
+        addEdge(tj, &edges, &edgeCount, &edgeCapacity, j, i);
+      }
+      firstSinceEffect = i + 1;
+    }
+  }
+  free(lastWriter);
+  free(readerHead);
+  free(readers);
+  free(files);
+  free(fileWriter);
+
+  // Successor lists in one array, indexed by successorStart
+  schedule->code = tj->program.code;
+  schedule->count = count;
+  schedule->pending = calloc(count + 1, sizeof(int));
+  schedule->successorStart = calloc(count + 2, sizeof(int));
+  schedule->successors = malloc((edgeCount + 1) * sizeof(int));
+  schedule->ready = malloc((count + 1) * sizeof(int));
+  if (schedule->pending == NULL || schedule->successorStart == NULL || schedule->successors == NULL
+      || schedule->ready == NULL) {
+    free(edges);
+    raiseError(tj, "Out of memory!");
+  }
+  for (size_t i = 0; i < edgeCount; i++) {
+    schedule->successorStart[edges[i].from + 2]++;
+    schedule->pending[edges[i].to]++;
+  }
+  for (int i = 2; i <= count + 1; i++) {
+    schedule->successorStart[i] += schedule->successorStart[i - 1];
+  }
+  for (size_t i = 0; i < edgeCount; i++) {
+    schedule->successors[schedule->successorStart[edges[i].from + 1]++] = edges[i].to;
+  }
+  free(edges);
+  schedule->readySize = 0;
+  for (int i = count - 1; i >= 0; i--) {
+    if (schedule->pending[i] == 0) {
+      schedule->ready[schedule->readySize++] = i;
+    }
+  }
+  schedule->completed = 0;
+  schedule->failedIndex = count;
+}
+
+static void freeSchedule(Schedule *schedule) {
+  free(schedule->pending);
+  free(schedule->successorStart);
+  free(schedule->successors);
+  free(schedule->ready);
+}
+
+// Instructions after a failed one are skipped; earlier ones still run, so
+// the error reported is the first one in program order
+static void runScheduled(TJInterpreter *context, Schedule *schedule, int index) {
+  if (index > __atomic_load_n(&schedule->failedIndex, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  Instruction code[2] = {schedule->code[index], {.op = OP_HALT}};
+  if (setjmp(context->onError) != 0) {
+    pthread_mutex_lock(&schedule->lock);
+    if (index < schedule->failedIndex) {
+      __atomic_store_n(&schedule->failedIndex, index, __ATOMIC_RELEASE);
+      memcpy(schedule->errorMessage, context->errorMessage, sizeof(schedule->errorMessage));
+      schedule->errorLine = context->errorLine;
+    }
+    pthread_mutex_unlock(&schedule->lock);
+    return;
+  }
+  runProgram(context, code);
+}
+
+// A worker keeps running one successor of the instruction it finished and
+// queues the others, so chains of dependent statements stay on one thread
+static void* runParallelWorker(void *argument) {
+  ParallelWorker *worker = argument;
+  Schedule *schedule = worker->schedule;
+  pthread_mutex_lock(&schedule->lock);
+  for (;;) {
+    while (schedule->readySize == 0 && __atomic_load_n(&schedule->completed, __ATOMIC_ACQUIRE) < schedule->count) {
+      pthread_cond_wait(&schedule->wake, &schedule->lock);
+    }
+    if (schedule->readySize == 0) {
+      break;
+    }
+    int index = schedule->ready[--schedule->readySize];
+    pthread_mutex_unlock(&schedule->lock);
+    while (index >= 0) {
+      runScheduled(&worker->context, schedule, index);
+      int next = -1;
+      for (int i = schedule->successorStart[index]; i < schedule->successorStart[index + 1]; i++) {
+        int successor = schedule->successors[i];
+        if (__atomic_sub_fetch(&schedule->pending[successor], 1, __ATOMIC_ACQ_REL) > 0) {
+          continue;
+        }
+        if (next < 0) {
+          next = successor;
+        } else {
+          pthread_mutex_lock(&schedule->lock);
+          schedule->ready[schedule->readySize++] = successor;
+          pthread_cond_signal(&schedule->wake);
+          pthread_mutex_unlock(&schedule->lock);
+        }
+      }
+      if (__atomic_add_fetch(&schedule->completed, 1, __ATOMIC_ACQ_REL) == schedule->count) {
+        pthread_mutex_lock(&schedule->lock);
+        pthread_cond_broadcast(&schedule->wake);
+        pthread_mutex_unlock(&schedule->lock);
+      }
+      index = next;
+    }
+    pthread_mutex_lock(&schedule->lock);
+  }
+  pthread_mutex_unlock(&schedule->lock);
+  return NULL;
+}
+
+// Runs the program on options.threads threads. Reads go through a shared
+// file cache, since the per-interpreter mapping registry is not thread-safe
+static void runParallel(TJInterpreter *tj) {
+  if (tj->options.files == NULL && tj->ownFiles == NULL) {
+    tj->ownFiles = tjCreateFileCache();
+    if (tj->ownFiles == NULL) {
+      raiseError(tj, "Out of memory!");
+    }
+  }
+  Schedule schedule;
+  buildSchedule(tj, &schedule);
+  int workerCount = tj->options.threads;
+  ParallelWorker *workers = malloc(workerCount * sizeof(ParallelWorker));
+  if (workers == NULL) {
+    freeSchedule(&schedule);
+    raiseError(tj, "Out of memory!");
+  }
+  pthread_mutex_init(&schedule.lock, NULL);
+  pthread_cond_init(&schedule.wake, NULL);
+  for (int i = 0; i < workerCount; i++) {
+    workers[i].context = *tj;
+    workers[i].context.concurrent = true;
+    workers[i].context.bytesAllocated = 0;
+    if (tj->options.files == NULL) {
+      workers[i].context.options.files = tj->ownFiles;
+    }
+    workers[i].schedule = &schedule;
+  }
+  int started = 1;
+  for (; started < workerCount; started++) {
+    if (pthread_create(&workers[started].thread, NULL, runParallelWorker, &workers[started]) != 0) {
+      break;
+    }
+  }
+  runParallelWorker(&workers[0]);
+  for (int i = 1; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  for (int i = 0; i < workerCount; i++) {
+    tj->bytesAllocated += workers[i].context.bytesAllocated;
+  }
+  free(workers);
+  pthread_cond_destroy(&schedule.wake);
+  pthread_mutex_destroy(&schedule.lock);
+  freeSchedule(&schedule);
+  if (schedule.failedIndex < schedule.count) {
+    tj->currentLine = schedule.errorLine;
+    raiseError(tj, schedule.errorMessage);
+  }
+}
+#endif
+
+// Lexes the whole source without parsing, then rewinds, so --stats can
+// report lexing and parsing time separately
+static double timeLexing(TJInterpreter *tj) {
+  double start = now();
+  Token token;
+  while ((token = getNextToken(tj)).type != ENDOFFILE) {
+    if (token.type == ENDOFLINE) {
+      arenaReset(tj);
+      tj->currentLine++;
+    }
+  }
+  double seconds = now() - start;
+  arenaReset(tj);
+  tj->cursor = tj->source;
+  tj->currentLine = 1;
+  return seconds;
+}
+
+
+//API
+
+TJOptions tjDefaultOptions(void) {
+  TJOptions options = {{NULL, NULL, NULL}, true, false, false, false, false, NULL, 0, false, 0, false, NULL};
+  return options;
+}
+
+TJInterpreter* tjCreate(const TJOptions *options) {
+  TJInterpreter *tj = calloc(1, sizeof(TJInterpreter));
+  if (tj == NULL) {
+    return NULL;
+  }
+  tj->options = options != NULL ? *options : tjDefaultOptions();
+  tj->output = &tj->ownOutput;
+  tj->currentLine = 1;
+  return tj;
+}
+
+// Releases everything that belongs to the current program; tables and
+// arena chunks keep their capacity
+static void clearProgram(TJInterpreter *tj) {
+  for (size_t i = 0; i < tj->variablesSize; i++) {
+    if (tj->variables[i].value.type == TEXT) {
+      releaseRope(tj, tj->variables[i].value.text);
+    }
+  }
+  tj->variablesSize = 0;
+  tjDestroyFileCache(tj->ownFiles);
+  tj->ownFiles = NULL;
+  for (size_t i = 0; i < tj->symbolsCapacity; i++) {
+    free(tj->symbols[i].name);
+  }
+  if (tj->symbols != NULL) {
+    memset(tj->symbols, 0, tj->symbolsCapacity * sizeof(Symbol));
+  }
+  tj->symbolsSize = 0;
+  if (tj->programMapped) {
+    tj->program.code = NULL;
+    tj->program.capacity = 0;
+    tj->program.operands = NULL;
+    tj->program.operandsCapacity = 0;
+    tj->programMapped = false;
+  }
+  tj->program.size = 0;
+  tj->program.operandsSize = 0;
+  tj->temporariesSize[INT] = 0;
+  tj->temporariesSize[TEXT] = 0;
+  freeOptimizer(tj);
+#ifdef HAVE_MMAP
+  if (tj->cacheBuffer != NULL) {
+    munmap(tj->cacheBuffer->bytes, tj->cacheBuffer->length);
+    freeSearchIndex(tj->cacheBuffer->index);
+    free(tj->cacheBuffer);
+    tj->cacheBuffer = NULL;
+  }
+#endif
+  free(tj->cachePath);
+  tj->cachePath = NULL;
+  tj->cacheHit = false;
+  free(tj->source);
+  tj->source = NULL;
+  tj->cursor = NULL;
+  tj->sourceEnd = NULL;
+  tj->sourceHash = 0;
+  tj->currentLine = 1;
+  tj->compiledLines = 0;
+  tj->lexSeconds = 0;
+  tj->compileSeconds = 0;
+  tj->executeSeconds = 0;
+  free(tj->lineProfile);
+  tj->lineProfile = NULL;
+  tj->profiledLines = 0;
+  tj->profiledInstruction = NULL;
+  memset(tj->opProfile, 0, sizeof(tj->opProfile));
+  arenaReset(tj);
+  tj->status = TJ_OK;
+  tj->errorMessage[0] = '\0';
+  tj->errorLine = 0;
+}
+
+void tjReset(TJInterpreter *tj) {
+  clearProgram(tj);
+}
+
+void tjDestroy(TJInterpreter *tj) {
+  if (tj == NULL) {
+    return;
+  }
+  clearProgram(tj);
+  free(tj->variables);
+  free(tj->symbols);
+  free(tj->program.code);
+  free(tj->program.operands);
+  free(tj->temporaries[INT]);
+  free(tj->temporaries[TEXT]);
+  free(tj->ownOutput.bytes);
+  free(tj->results);
+  free(tj->knownFiles);
+#ifdef HAVE_MMAP
+  for (size_t i = 0; i < tj->mappedFilesSize; i++) {
+    free(tj->mappedFiles[i].path);
+  }
+  free(tj->mappedFiles);
+#endif
+  ArenaChunk *chunk = tj->arena.first;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(tj);
+}
+
+// Compiles the loaded source, or loads it from the cache when cachePath is set
+static void compileLoaded(TJInterpreter *tj) {
+  double start = now();
+  tj->cacheHit = tj->cachePath != NULL && !tj->options.rebuildCache && loadCache(tj, tj->cachePath);
+  if (!tj->cacheHit) {
+    if (tj->options.timeLexing) {
+      tj->lexSeconds = timeLexing(tj);
+      start = now();
+    }
+    compileProgram(tj);
+    tj->compiledLines = tj->currentLine;
+    if (tj->options.optimize) {
+      optimizeProgram(tj);
+    }
+    if (tj->cachePath != NULL) {
+      saveCache(tj, tj->cachePath);
+    }
+  }
+  tj->compileSeconds = now() - start;
+}
+
+TJStatus tjCompileFile(TJInterpreter *tj, const char *path) {
+  clearProgram(tj);
+  if (setjmp(tj->onError) != 0) {
+    return tj->status = TJ_ERROR_COMPILE;
+  }
+  if (!loadSource(tj, path)) {
+    snprintf(tj->errorMessage, sizeof(tj->errorMessage), "Cannot open file: %s", path);
+    return tj->status = TJ_ERROR_OPEN;
+  }
+  if (tj->options.useCache) {
+    tj->cachePath = cachePathOf(tj, path);
+  }
+  compileLoaded(tj);
+  return TJ_OK;
+}
+
+TJStatus tjCompileSource(TJInterpreter *tj, const char *source, size_t length) {
+  clearProgram(tj);
+  if (setjmp(tj->onError) != 0) {
+    return tj->status = TJ_ERROR_COMPILE;
+  }
+  tj->source = allocate(tj, length + SOURCE_PADDING);
+  memcpy(tj->source, source, length);
+  memset(tj->source + length, 0, SOURCE_PADDING);
+  tj->cursor = tj->source;
+  tj->sourceEnd = tj->source + length;
+  compileLoaded(tj);
+  return TJ_OK;
+}
+
+// Every run starts from zero and empty variables, which the optimizer
+// relies on; constants have no name and keep their values
+static void resetVariables(TJInterpreter *tj) {
+  for (size_t i = 0; i < tj->variablesSize; i++) {
+    Variable *variable = &tj->variables[i];
+    if (variable->name == NULL) {
+      continue;
+    }
+    if (variable->value.type == TEXT) {
+      setText(tj, &variable->value, &emptyRope);
+    } else {
+      variable->value.number = 0;
+    }
+  }
+}
+
+TJStatus tjRun(TJInterpreter *tj) {
+  // A runtime error ends only the run it happened in
+  if (tj->status == TJ_ERROR_RUNTIME) {
+    tj->status = TJ_OK;
+    tj->errorMessage[0] = '\0';
+    tj->errorLine = 0;
+  }
+  if (tj->status != TJ_OK || tj->program.size == 0) {
+    if (tj->status == TJ_OK) {
+      snprintf(tj->errorMessage, sizeof(tj->errorMessage), "No program compiled!");
+      tj->status = TJ_ERROR_RUNTIME;
+    }
+    return tj->status;
+  }
+  double start = now();
+  if (setjmp(tj->onError) != 0) {
+#ifdef HAVE_THREADS
+    stopAsyncIO(tj);
+#endif
+    flushOutput(tj, NULL, 0);
+    if (tj->resultsChanged) {
+      saveResults(tj);
+    }
+    tj->executeSeconds = now() - start;
+    return tj->status = TJ_ERROR_RUNTIME;
+  }
+  if (tj->options.profile) {
+    startProfiling(tj);
+  }
+  resetVariables(tj);
+  tj->resultHits = 0;
+  tj->resultMisses = 0;
+  if (tj->options.results != NULL && !tj->resultsLoaded) {
+    loadResults(tj);
+  }
+#ifdef HAVE_THREADS
+  // The result cache and the I/O thread are not shared between threads
+  if (tj->options.threads > 1 && !tj->options.profile && tj->options.results == NULL && tj->program.size > 2
+      && !hasLoops(tj)) {
+    runParallel(tj);
+  } else {
+    if (tj->options.asyncIO) {
+      startAsyncIO(tj);
+    }
+    runProgram(tj, tj->program.code);
+    if (tj->io != NULL) {
+      flushWrites(tj);
+      stopAsyncIO(tj);
+    }
+  }
+#else
+  runProgram(tj, tj->program.code);
+#endif
+  flushOutput(tj, NULL, 0);
+  if (tj->resultsChanged) {
+    saveResults(tj);
+  }
+  tj->executeSeconds = now() - start;
+  return TJ_OK;
+}
+
+TJStatus tjRunFile(TJInterpreter *tj, const char *path) {
+  TJStatus status = tjCompileFile(tj, path);
+  return status == TJ_OK ? tjRun(tj) : status;
+}
+
+const char* tjErrorMessage(const TJInterpreter *tj) {
+  return tj->errorMessage;
+}
+
+int tjErrorLine(const TJInterpreter *tj) {
+  return tj->errorLine;
+}
+
+TJStatistics tjGetStatistics(const TJInterpreter *tj) {
+  TJStatistics statistics;
+  statistics.statements = tj->compiledLines > 0 ? tj->compiledLines - 1 : 0;
+  statistics.instructions = tj->program.size > 0 ? tj->program.size - 1 : 0;
+  statistics.sourceBytes = (size_t) (tj->sourceEnd - tj->source);
+  statistics.lexSeconds = tj->lexSeconds;
+  statistics.parseSeconds = tj->compileSeconds > tj->lexSeconds ? tj->compileSeconds - tj->lexSeconds : 0;
+  statistics.executeSeconds = tj->executeSeconds;
+  statistics.arenaPeakBytes = tj->arena.peak;
+  statistics.cacheHit = tj->cacheHit;
+  statistics.resultHits = tj->resultHits;
+  statistics.resultMisses = tj->resultMisses;
+  return statistics;
+}
+
+void tjWriteProfile(TJInterpreter *tj, FILE *file, bool json) {
+  if (tj->profiledInstruction != NULL) {
+    Instruction halt = {.op = OP_HALT};
+    profileStep(tj, &halt);
+  }
+  if (json) {
+    printProfileJson(tj, file);
+  } else {
+    printProfileTable(tj, file);
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef TEXTJEDI_H
+#define TEXTJEDI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Embeddable TextJedi interpreter. All state lives in a TJInterpreter, so a
+// host can run any number of them, one per thread, without locking. Errors
+// are returned as a TJStatus; the library never exits or prints on its own.
+
+typedef struct TJInterpreter TJInterpreter;
+
+// Files loaded by read statements, mapped once and shared read-only by
+// every interpreter that has it in its options. Thread-safe; destroy it only
+// after the interpreters using it.
+typedef struct TJFileCache TJFileCache;
+
+typedef enum {
+  TJ_OK,
+  TJ_ERROR_OPEN,
+  TJ_ERROR_COMPILE,
+  TJ_ERROR_RUNTIME
+} TJStatus;
+
+// Where output and input statements go. write receives output whenever
+// outputBuffer bytes have collected, before every input and at the end of
+// every run; readLine stores at most capacity bytes of the next input line,
+// without its newline, and returns how many. A NULL callback means stdout
+// or stdin.
+typedef struct {
+  void* context;
+  void (*write)(void *context, const char *bytes, size_t length);
+  size_t (*readLine)(void *context, char *buffer, size_t capacity);
+} TJHost;
+
+typedef struct {
+  TJHost host;
+  bool optimize;       // Constant folding and dead-store elimination
+  bool useCache;       // Reuse and update <file>.tjc next to compiled files
+  bool rebuildCache;   // Compile even if the cache is valid, then update it
+  bool profile;        // Per statement kind and line costs, see tjWriteProfile
+  bool timeLexing;     // Lex once more before compiling to time it separately
+  TJFileCache* files;  // Shared cache for read statements, or NULL
+  int threads;         // Threads for independent statements and large texts
+  bool asyncIO;        // Prefetch read files and write files in the background,
+                       // unless statements run in parallel (threads > 1)
+  size_t outputBuffer; // Bytes of output collected before writing, 0 for 64 KiB
+  bool lineBuffered;   // Write output at every newline, for interactive use
+  const char* results; // Directory keeping search results across runs, or NULL
+} TJOptions;
+
+typedef struct {
+  int statements;
+  size_t instructions;
+  size_t sourceBytes;
+  double lexSeconds;
+  double parseSeconds;
+  double executeSeconds;
+  size_t arenaPeakBytes;
+  bool cacheHit;
+  size_t resultHits;
+  size_t resultMisses;
+} TJStatistics;
+
+// Optimizing, no cache, no profile, standard input and output
+TJOptions tjDefaultOptions(void);
+
+// Returns NULL if out of memory or if the platform cannot share mappings
+TJFileCache* tjCreateFileCache(void);
+void tjDestroyFileCache(TJFileCache *cache);
+
+// NULL options mean tjDefaultOptions(); returns NULL if out of memory
+TJInterpreter* tjCreate(const TJOptions *options);
+void tjDestroy(TJInterpreter *tj);
+
+// Compiling replaces the previous program. Every tjRun starts with its
+// variables zero or empty, so running a program again repeats its output.
+// After a runtime error the program can be run again; after a failed
+// compile tjRun returns that error until a compile succeeds.
+TJStatus tjCompileFile(TJInterpreter *tj, const char *path);
+TJStatus tjCompileSource(TJInterpreter *tj, const char *source, size_t length);
+TJStatus tjRun(TJInterpreter *tj);
+TJStatus tjRunFile(TJInterpreter *tj, const char *path);
+
+// Frees the program, its variables and mapped files but keeps tables and
+// arena chunks allocated, so the next compile of a similar program does not
+// go back to malloc
+void tjReset(TJInterpreter *tj);
+
+// Message and source line of the last error; line is 0 if it has none
+const char* tjErrorMessage(const TJInterpreter *tj);
+int tjErrorLine(const TJInterpreter *tj);
+
+TJStatistics tjGetStatistics(const TJInterpreter *tj);
+
+// Writes the profile of the last run as a table or as JSON
+void tjWriteProfile(TJInterpreter *tj, FILE *file, bool json);
+
+#endif